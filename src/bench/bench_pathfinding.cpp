@@ -0,0 +1,486 @@
+/*
+ * File:	bench_pathfinding.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Headless path finding benchmark. Builds reproducible maps, runs random
+ * queries over them with each search mode, and prints one row per run as
+ * CSV or JSON.
+ *
+ * Usage: bench_pathfinding [--sizes 50,256,...] [--scenarios open,maze,...]
+ *                          [--modes astar,jps,bucket,hpa] [--queries N]
+ *                          [--routes random|across] [--seed S]
+ *                          [--format csv|json]
+ *
+ * hpa queries go over a ClusterGraph built before the first query, setup_ms
+ * is how long building it took. Routes across run from the west edge of the
+ * map to the east edge, random ones between any two cells.
+ *
+ * peak_kb is the process high water mark so far, sizes are best listed
+ * smallest first.
+ */
+
+#include "map/map.h"
+#include "map/cost_grid.h"
+#include "path/path_search.h"
+#include "path/cluster_graph.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// indices into Cell::Types
+#define GRASS	0
+#define LAVA	1
+#define WALL	4
+#define WATER	5
+
+// width of the water channels between corridor walls
+#define CORRIDOR_WIDTH	6
+
+// not a PathSearch mode, queries go over a ClusterGraph
+#define HPA		-1
+
+// routes across start in the westmost 1/EDGE_BAND of the map and end in the
+// eastmost
+#define EDGE_BAND	16
+
+typedef struct
+{
+	std::string scenario;
+	std::string mode;
+	int size;
+
+	size_t queries, found;
+	size_t nodes;
+	double setup, seconds;
+
+	double p50, p99, max;
+	long peak_kb;
+} result_t;
+
+/*
+ * Small deterministic generator, the same stream on every platform
+ */
+class Random
+{
+	public:
+		Random( uint64_t seed ) : state(seed ? seed : 1) {}
+
+		uint32_t next()
+		{
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			return (uint32_t)(state >> 16);
+		}
+
+		int range( int n ) { return n > 0 ? (int)(next() % (uint32_t)n) : 0; }
+
+	private:
+		uint64_t state;
+};
+
+/*
+ * Everything grass
+ */
+static void makeOpen( Map &map, Random &rng )
+{
+}
+
+/*
+ * Walls everywhere except a perfect maze carved over the odd cells, so
+ * every two open cells are joined by exactly one corridor
+ */
+static void makeMaze( Map &map, Random &rng )
+{
+	const int w = map.getWidth(), h = map.getHeight();
+	const int cells_w = (w - 1) / 2, cells_h = (h - 1) / 2;
+
+	for( int x = 0; x < w; x++ )
+	{
+		for( int y = 0; y < h; y++ )
+		{
+			if( x % 2 == 0 || y % 2 == 0 || x/2 >= cells_w || y/2 >= cells_h )
+				map.setCellBase( x, y, WALL );
+		}
+	}
+
+	if( cells_w <= 0 || cells_h <= 0 ) return;
+
+	static const int dirs[4][2] = { {1,0}, {-1,0}, {0,1}, {0,-1} };
+
+	std::vector<bool> visited( cells_w*cells_h, false );
+	std::vector<int> stack;
+
+	stack.push_back( 0 );
+	visited[0] = true;
+
+	while( !stack.empty() )
+	{
+		const int cell = stack.back();
+		const int cx = cell % cells_w, cy = cell / cells_w;
+
+		int options[4], count = 0;
+		for( int d = 0; d < 4; d++ )
+		{
+			const int nx = cx + dirs[d][0], ny = cy + dirs[d][1];
+			if( nx < 0 || ny < 0 || nx >= cells_w || ny >= cells_h ) continue;
+			if( !visited[ny*cells_w + nx] ) options[count++] = d;
+		}
+
+		if( count == 0 )
+		{
+			stack.pop_back();
+			continue;
+		}
+
+		const int d = options[ rng.range(count) ];
+		const int nx = cx + dirs[d][0], ny = cy + dirs[d][1];
+
+		// knock out the wall between the two
+		map.setCellBase( 2*cx + 1 + dirs[d][0], 2*cy + 1 + dirs[d][1], GRASS );
+
+		visited[ny*cells_w + nx] = true;
+		stack.push_back( ny*cells_w + nx );
+	}
+}
+
+/*
+ * Round lakes of lava covering about a quarter of the map
+ */
+static void makeLava( Map &map, Random &rng )
+{
+	const int w = map.getWidth(), h = map.getHeight();
+	const size_t target = (size_t)w*h / 4;
+
+	size_t covered = 0;
+	while( covered < target )
+	{
+		const int r = 2 + rng.range( std::max(2, std::min(w, h) / 16) );
+		const int cx = rng.range( w ), cy = rng.range( h );
+
+		for( int x = std::max(0, cx - r); x <= std::min(w - 1, cx + r); x++ )
+		{
+			for( int y = std::max(0, cy - r); y <= std::min(h - 1, cy + r); y++ )
+			{
+				if( (x - cx)*(x - cx) + (y - cy)*(y - cy) > r*r ) continue;
+				if( map.getCell( x, y ).getBaseId() == LAVA ) continue;
+
+				map.setCellBase( x, y, LAVA );
+				covered++;
+			}
+		}
+	}
+}
+
+/*
+ * Long water channels separated by walls, with a few gaps in each wall
+ */
+static void makeCorridors( Map &map, Random &rng )
+{
+	const int w = map.getWidth(), h = map.getHeight();
+
+	for( int y = 0; y < h; y++ )
+	{
+		if( y % (CORRIDOR_WIDTH + 1) != CORRIDOR_WIDTH )
+		{
+			for( int x = 0; x < w; x++ )
+				map.setCellBase( x, y, WATER );
+			continue;
+		}
+
+		// a gap roughly every 64 cells, at least one per wall
+		const int gaps = std::max( 1, w / 64 );
+		std::vector<bool> gap( w, false );
+		for( int i = 0; i < gaps; i++ )
+			gap[ rng.range(w) ] = true;
+
+		for( int x = 0; x < w; x++ )
+		{
+			if( !gap[x] ) map.setCellBase( x, y, WALL );
+		}
+	}
+}
+
+/*
+ * Noise generated lakes, lava and open ground
+ */
+static Map* makeTerrain( int size, Random &rng )
+{
+	return Map::generate( size, size, rng.next() );
+}
+
+typedef struct
+{
+	const char *name;
+
+	/// Makes the map, a new map of grass if NULL
+	Map* (*create)( int size, Random &rng );
+
+	/// Edits the map after it is made, if not NULL
+	void (*build)( Map &map, Random &rng );
+} scenario_t;
+
+static const scenario_t scenarios[] =
+{
+	{ "open",		NULL,			makeOpen },
+	{ "maze",		NULL,			makeMaze },
+	{ "lava",		NULL,			makeLava },
+	{ "corridors",	NULL,			makeCorridors },
+	{ "terrain",	makeTerrain,	NULL },
+};
+
+typedef struct
+{
+	const char *name;
+	int mode;
+} search_mode_t;
+
+static const search_mode_t modes[] =
+{
+	{ "astar",	PathSearch::ASTAR },
+	{ "jps",	PathSearch::JUMP_POINT },
+	{ "bucket",	PathSearch::BUCKET },
+	{ "hpa",	HPA },
+};
+
+/*
+ * Random passable cell with x from min_x up to max_x
+ */
+static CL_Point randomCell( const CostGrid &grid, Random &rng, int min_x, int max_x )
+{
+	for(;;)
+	{
+		const int x = min_x + rng.range( max_x - min_x ), y = rng.range( grid.getHeight() );
+		if( grid.get( x, y ) >= 0 ) return CL_Point( x, y );
+	}
+}
+
+static double percentile( const std::vector<double> &sorted, double p )
+{
+	if( sorted.empty() ) return 0;
+
+	const size_t i = std::min( sorted.size() - 1, (size_t)(p * sorted.size()) );
+	return sorted[i];
+}
+
+static long peakMemory()
+{
+	struct rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	return usage.ru_maxrss;
+}
+
+/*
+ * Run every query of one scenario with one mode
+ */
+static result_t run( const CostGrid &grid, const std::vector<CL_Point> &queries, const search_mode_t &mode )
+{
+	PathSearch search( &grid );
+	std::vector<CL_Point> path;
+	std::vector<double> latencies;
+
+	result_t result;
+	result.mode = mode.name;
+	result.queries = queries.size() / 2;
+	result.found = 0;
+	result.nodes = 0;
+	result.setup = 0;
+	result.seconds = 0;
+
+	ClusterGraph *graph = NULL;
+	if( mode.mode == HPA )
+	{
+		auto begin = std::chrono::steady_clock::now();
+		graph = new ClusterGraph( &grid );
+		graph->update();
+		result.setup = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+	}
+
+	for( size_t i = 0; i + 1 < queries.size(); i += 2 )
+	{
+		const CL_Point &start = queries[i], &goal = queries[i + 1];
+
+		auto begin = std::chrono::steady_clock::now();
+		const bool found = graph
+			? graph->findPath( start.x, start.y, goal.x, goal.y, path )
+			: search.findPath( start.x, start.y, goal.x, goal.y, path, NULL, 1.0, NULL, mode.mode );
+		auto end = std::chrono::steady_clock::now();
+
+		const double seconds = std::chrono::duration<double>( end - begin ).count();
+
+		latencies.push_back( seconds );
+		result.seconds += seconds;
+		result.nodes += graph ? graph->getNodesExpanded() : search.getNodesExpanded();
+		if( found ) result.found++;
+	}
+
+	delete graph;
+
+	std::sort( latencies.begin(), latencies.end() );
+	result.p50 = percentile( latencies, 0.50 );
+	result.p99 = percentile( latencies, 0.99 );
+	result.max = latencies.empty() ? 0 : latencies.back();
+	result.peak_kb = peakMemory();
+
+	return result;
+}
+
+static void printCsvHeader()
+{
+	printf( "scenario,size,mode,queries,found,nodes,setup_ms,seconds,nodes_per_sec,p50_ms,p99_ms,max_ms,peak_kb\n" );
+}
+
+static void printCsv( const result_t &r )
+{
+	printf( "%s,%d,%s,%zu,%zu,%zu,%.1f,%.6f,%.0f,%.4f,%.4f,%.4f,%ld\n",
+			r.scenario.c_str(), r.size, r.mode.c_str(), r.queries, r.found, r.nodes, r.setup*1000, r.seconds,
+			r.seconds > 0 ? r.nodes / r.seconds : 0.0, r.p50*1000, r.p99*1000, r.max*1000, r.peak_kb );
+}
+
+static void printJson( const result_t &r, bool first )
+{
+	printf( "%s\n  {\"scenario\": \"%s\", \"size\": %d, \"mode\": \"%s\", \"queries\": %zu, \"found\": %zu, "
+			"\"nodes\": %zu, \"setup_ms\": %.1f, \"seconds\": %.6f, \"nodes_per_sec\": %.0f, \"p50_ms\": %.4f, "
+			"\"p99_ms\": %.4f, \"max_ms\": %.4f, \"peak_kb\": %ld}",
+			first ? "" : ",", r.scenario.c_str(), r.size, r.mode.c_str(), r.queries, r.found, r.nodes,
+			r.setup*1000, r.seconds, r.seconds > 0 ? r.nodes / r.seconds : 0.0, r.p50*1000, r.p99*1000, r.max*1000, r.peak_kb );
+}
+
+static std::vector<std::string> split( const char *list )
+{
+	std::vector<std::string> parts;
+	std::string cur;
+
+	for( const char *c = list; *c; c++ )
+	{
+		if( *c == ',' )
+		{
+			if( !cur.empty() ) parts.push_back( cur );
+			cur.clear();
+		}
+		else cur += *c;
+	}
+	if( !cur.empty() ) parts.push_back( cur );
+
+	return parts;
+}
+
+static bool wanted( const std::vector<std::string> &list, const char *name )
+{
+	return list.empty() || std::find( list.begin(), list.end(), name ) != list.end();
+}
+
+static void usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [--sizes 50,256,...] [--scenarios open,maze,lava,corridors,terrain]\n"
+			"       [--modes astar,jps,bucket,hpa] [--queries N] [--routes random|across]\n"
+			"       [--seed S] [--format csv|json]\n", prog );
+}
+
+int main( int argc, char **argv )
+{
+	std::vector<int> sizes = { 50, 128, 256, 512, 1024, 2048, 4096 };
+	std::vector<std::string> scenario_list, mode_list;
+	size_t queries = 100;
+	uint64_t seed = 1;
+	bool json = false, across = false;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( i + 1 >= argc )
+		{
+			usage( argv[0] );
+			return 1;
+		}
+
+		const char *opt = argv[i], *arg = argv[++i];
+
+		if( !strcmp(opt, "--sizes") )
+		{
+			sizes.clear();
+			for( const std::string &s : split(arg) )
+				sizes.push_back( atoi(s.c_str()) );
+		}
+		else if( !strcmp(opt, "--scenarios") ) scenario_list = split( arg );
+		else if( !strcmp(opt, "--modes") ) mode_list = split( arg );
+		else if( !strcmp(opt, "--queries") ) queries = strtoul( arg, NULL, 10 );
+		else if( !strcmp(opt, "--routes") ) across = !strcmp( arg, "across" );
+		else if( !strcmp(opt, "--seed") ) seed = strtoull( arg, NULL, 10 );
+		else if( !strcmp(opt, "--format") ) json = !strcmp( arg, "json" );
+		else
+		{
+			usage( argv[0] );
+			return 1;
+		}
+	}
+
+	if( json ) printf( "[" );
+	else printCsvHeader();
+
+	bool first = true;
+
+	for( int size : sizes )
+	{
+		if( size < 8 ) continue;
+
+		for( const scenario_t &scenario : scenarios )
+		{
+			if( !wanted( scenario_list, scenario.name ) ) continue;
+
+			// same map and queries for a given seed, whatever else is run
+			Random rng( seed * 1000003 + size );
+
+			Map *map = scenario.create ? scenario.create( size, rng ) : new Map( size, size );
+			if( scenario.build ) scenario.build( *map, rng );
+
+			const CostGrid &grid = map->getCostGrid();
+
+			const int band = std::max( 1, size / EDGE_BAND );
+
+			std::vector<CL_Point> points;
+			for( size_t i = 0; i < queries; i++ )
+			{
+				if( across )
+				{
+					points.push_back( randomCell( grid, rng, 0, band ) );
+					points.push_back( randomCell( grid, rng, size - band, size ) );
+				}
+				else
+				{
+					points.push_back( randomCell( grid, rng, 0, size ) );
+					points.push_back( randomCell( grid, rng, 0, size ) );
+				}
+			}
+
+			for( const search_mode_t &mode : modes )
+			{
+				if( !wanted( mode_list, mode.name ) ) continue;
+
+				result_t result = run( grid, points, mode );
+				result.scenario = scenario.name;
+				result.size = size;
+
+				if( json ) printJson( result, first );
+				else printCsv( result );
+
+				first = false;
+				fflush( stdout );
+			}
+
+			delete map;
+		}
+	}
+
+	if( json ) printf( "\n]\n" );
+
+	return 0;
+}
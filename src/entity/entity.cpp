@@ -7,17 +7,19 @@
  */
 
 #include "entity/entity.h"
-#include "game.h"
-#include "map/tileset.h"
+#include "map/spatial_index.h"
+
+const Entity::Color Entity::hotpink = { 1.0f, 105/255.0f, 180/255.0f, 1.0f };
 
 /**
  * Entity(map, x, y, color)
  *
  * Creates a new entity at the starting location defined by x and y
  */
-Entity::Entity(Map *map, int startLocationX, int startLocationY, CL_Colorf startColor)
+Entity::Entity(Map *map, int startLocationX, int startLocationY, Color startColor)
     : map(map), current_x(startLocationX), current_y(startLocationY), entity_color(startColor)
 {
+    map->getEntityIndex().insert(this, current_x, current_y);
 }
 
 /**
@@ -27,36 +29,39 @@ Entity::Entity(Map *map, int startLocationX, int startLocationY, CL_Colorf start
  */
 Entity::~Entity()
 {
-    //TODO: something here?
+    map->getEntityIndex().erase(this, current_x, current_y);
 }
 
 /**
- * draw(gc)
+ * update()
  *
- * draws the entity on the given graphic context
+ * Updates the Entity
  */
-void Entity::draw(CL_GraphicContext &gc, double cell_width, double cell_height, double map_origin_x, double map_origin_y )
+void Entity::update( )
 {
-    gc.push_modelview();
-
-    gc.set_translate(current_x*cell_width + map_origin_x, current_y*cell_height + map_origin_y, 0);
-	CL_Sprite &sprite( Game::get_tileset() );
-
-	sprite.set_frame( ROBOT_NS_ID );
-	sprite.set_scale( cell_width/TILESET_SIZE, cell_height/TILESET_SIZE );
-
-	sprite.draw( gc, 0, 0 );
+}
 
-    gc.pop_modelview();
+/**
+ * getDrawPosition(alpha, x, y)
+ *
+ * Entities that don't move are drawn on their cell
+ */
+void Entity::getDrawPosition(double alpha, double &x, double &y)
+{
+    x = current_x;
+    y = current_y;
 }
 
 /**
- * update()
+ * moveTo(x, y)
  *
- * Updates the Entity
+ * Moves the entity to x, y
  */
-void Entity::update( )
+void Entity::moveTo(int x, int y)
 {
+    map->getEntityIndex().move(this, current_x, current_y, x, y);
+    current_x = x;
+    current_y = y;
 }
 
 /**
@@ -66,7 +71,8 @@ void Entity::update( )
  */
 void Entity::setColor(float r, float g, float b)
 {
-    entity_color = CL_Colorf(r, g, b);
+    Color color = { r, g, b, 1.0f };
+    entity_color = color;
 }
 
 /**
@@ -74,7 +80,7 @@ void Entity::setColor(float r, float g, float b)
  *
  * sets the color of this entity
  */
-void Entity::setColor(CL_Colorf newColor)
+void Entity::setColor(Color newColor)
 {
     entity_color = newColor;
 }
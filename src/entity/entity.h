@@ -10,24 +10,35 @@
 #define ENTITY_H
 
 #include "map/map.h"
-#include <ClanLib/display.h>
 
 class Entity
 {
     public:
+        /**
+         * Color
+         *
+         * colour of an entity, each component from 0 to 1
+         */
+        struct Color
+        {
+            float r, g, b, a;
+        };
+
+        static const Color hotpink;
+
         /**
          * Entity(map)
          *
          * creates a new entity on the map at the specified location
          */
-        Entity(Map *map, int startLocationX, int startLocationY, CL_Colorf startColor = CL_Colorf::hotpink);
+        Entity(Map *map, int startLocationX, int startLocationY, Color startColor = hotpink);
 
         /**
          * ~Entity()
          *
          * Entity destructor
          */
-        ~Entity();
+        virtual ~Entity();
 
         /**
          * getXLocation()
@@ -51,11 +62,11 @@ class Entity
         virtual void update();
 
         /**
-         * draw(gc)
+         * getDrawPosition(alpha, x, y)
          *
-         * Draws the entity
+         * where the entity is shown, alpha of a tick on from its last update
          */
-        void draw(CL_GraphicContext &gc, double cell_width, double cell_height, double map_origin_x, double map_origin_y);
+        virtual void getDrawPosition(double alpha, double &x, double &y);
 
         /**
          * setColor(r, g, b)
@@ -63,11 +74,18 @@ class Entity
          * sets the color that this entity will display as
          */
         void setColor(float r, float g, float b);
-        void setColor(CL_Colorf newColor);
+        void setColor(Color newColor);
 
 		virtual bool isIdle() = 0;
 
     protected:
+        /**
+         * moveTo(x, y)
+         *
+         * moves the entity, keeping the map's index of entities up to date
+         */
+        void moveTo(int x, int y);
+
         // The map this entity is on
         Map *map;
 
@@ -76,7 +94,7 @@ class Entity
         int current_y;
 
         // color storage
-        CL_Colorf entity_color;
+        Color entity_color;
 
 };
 
@@ -3,17 +3,16 @@
  *
  * Author:  Ben Reeves
  *
- * Base class for all entities that are self-propelled
+ * Base class for all entities that are self-propelled. The state of every
+ * mover on a map lives in the map's MoverStore; a Mover is a handle onto its
+ * slot there.
  */
 
 #ifndef MOVER_H
 #define MOVER_H
 
 #include "entity.h"
-
-#include<ClanLib/core.h>
-#include <queue>
-#include <vector>
+#include "entity/mover_store.h"
 
 class Mover : public Entity
 {
@@ -22,57 +21,70 @@ class Mover : public Entity
          * Constructor
          */
         Mover(Map *map, int startLocationX, int startLocationY, 
-                CL_Colorf startColor = CL_Colorf::hotpink);
+                Color startColor = hotpink);
+
+        virtual ~Mover();
 
         /**
          * function update()
          *
-         * overridden from Entity to provide motion to the object
+         * overridden from Entity to provide motion to the object, plan()
+         * then apply()
          */
         virtual void update();
 
         /**
-         * function setDestination(point)
+         * function plan()
          *
-         * tells the mover to travel to a point
+         * first half of an update: works out what to do this tick, changing
+         * nothing but this mover. Any number of movers can plan at once.
+         * Returns true if apply() has something to do.
          */
-        void setDestination(int destination_x, int destination_y);
-
-		/**
-		 * Returns true if this mover has no current path to follow
-		 */
-		virtual bool isIdle();
-
-    protected:
+        bool plan();
 
         /**
-         * Used to create a path to the current destination
+         * function apply()
+         *
+         * second half of an update: carries out the plan, moving on the map,
+         * building and talking to the job board. Movers apply one at a time.
          */
-        bool findPath(double *cost = NULL, const int accuracy = 1.0 );//, int step_size = 1);
+        void apply();
 
         /**
-         * Storage for the destination point
+         * function setDestination(point)
+         *
+         * tells the mover to travel to a point, shared destinations are
+         * reached through the map's flow fields
          */
-        int destination_x, destination_y;
+        void setDestination(int destination_x, int destination_y, bool shared = false);
 
 		/**
-		 * Delay for movement cost
+		 * Returns true if this mover has no current path to follow
 		 */
-		double delay_count;
+		virtual bool isIdle();
 
         /**
-         * Storage for the path
+         * function getDrawPosition(alpha, x, y)
+         *
+         * overridden from Entity to show the mover part way to its next cell
          */
-        std::queue<CL_Point> path;
+        virtual void getDrawPosition(double alpha, double &x, double &y);
 
         /**
-         * flag set when there's a new destination
+         * function stop()
+         *
+         * forget the destination and any path to it
          */
-        bool has_destination = false;
+        void stop();
 
     private:
-        double getDistanceSquared(double originX, double originY, double destinationX, double destinationY);
-        std::vector<std::pair<double, double> > neighbors();
+        friend class MoverStore;
+
+        /**
+         * slot holding this mover's state in the map's MoverStore, kept up
+         * to date by the store as slots move
+         */
+        MoverStore::slot_t slot;
 };
 
 #endif
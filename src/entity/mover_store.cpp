@@ -0,0 +1,388 @@
+/**
+ * File:    mover_store.cpp
+ *
+ * Author:  Ben Reeves
+ *
+ * State and behaviour of every mover on a map, component by component
+ */
+
+#include "entity/mover_store.h"
+#include "entity/mover.h"
+#include "path/dstar_lite.h"
+#include "path/path_search.h"
+#include "path/flow_field.h"
+#include "job/job_board.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// edits covering more cells than this restart a planner instead of repairing it
+#define MAX_REPLAN_CELLS    4096
+
+MoverStore::MoverStore(Map *map)
+    : map(map)
+{
+}
+
+MoverStore::~MoverStore()
+{
+    for( DStarLite *planner : planners )
+        delete planner;
+}
+
+MoverStore::slot_t MoverStore::add(Mover *owner, int x, int y)
+{
+    xs.push_back(x);
+    ys.push_back(y);
+    delays.push_back(0);
+    flags.push_back(0);
+    actions.push_back(ACTION_NONE);
+    tickets.push_back(PathService::ticket_t(PathService::NO_TICKET));
+    paths.push_back(std::vector<CL_Point>());
+
+    destinations.push_back(CL_Point(x, y));
+    next_steps.push_back(CL_Point(x, y));
+    planners.push_back(NULL);
+    planner_versions.push_back(0);
+
+    owners.push_back(owner);
+
+    return owners.size() - 1;
+}
+
+void MoverStore::remove(slot_t slot)
+{
+    cancelPath(slot);
+    delete planners[slot];
+
+    // fill the hole with the last slot, keeping the arrays dense
+    const slot_t last = owners.size() - 1;
+    if( slot != last )
+    {
+        xs[slot] = xs[last];
+        ys[slot] = ys[last];
+        delays[slot] = delays[last];
+        flags[slot] = flags[last];
+        actions[slot] = actions[last];
+        tickets[slot] = tickets[last];
+        paths[slot].swap(paths[last]);
+
+        destinations[slot] = destinations[last];
+        next_steps[slot] = next_steps[last];
+        planners[slot] = planners[last];
+        planner_versions[slot] = planner_versions[last];
+
+        owners[slot] = owners[last];
+        owners[slot]->slot = slot;
+    }
+
+    xs.pop_back();
+    ys.pop_back();
+    delays.pop_back();
+    flags.pop_back();
+    actions.pop_back();
+    tickets.pop_back();
+    paths.pop_back();
+
+    destinations.pop_back();
+    next_steps.pop_back();
+    planners.pop_back();
+    planner_versions.pop_back();
+
+    owners.pop_back();
+}
+
+bool MoverStore::isIdle(slot_t slot)
+{
+    return !( (flags[slot] & HAS_DESTINATION) || !paths[slot].empty() || tickets[slot] != PathService::NO_TICKET )
+        && map->isBuilt( xs[slot], ys[slot] );
+}
+
+bool MoverStore::plan(slot_t slot)
+{
+    const int x = xs[slot], y = ys[slot];
+    uint8_t action = ACTION_NONE;
+
+    if( tickets[slot] != PathService::NO_TICKET )
+    {
+        // waiting on the path service, whose cache fills in the order
+        // answers are collected
+        action = ACTION_POLL_PATH;
+    }
+    else if( !paths[slot].empty() )
+    {
+        // update location here
+        delays[slot] += MOVE_SPEED;
+        if( delays[slot] >= map->getMoveCost(x, y) )
+        {
+            delays[slot] = 0;
+
+            std::vector<CL_Point> &path = paths[slot];
+            const CL_Point next = path.back();
+            path.pop_back();
+            next_steps[slot] = next;
+
+            if( map->getMoveCost(next.x, next.y) > 0 )
+            {
+                action = ACTION_MOVE;
+            }
+            else
+            {
+                // map changed, repair the path around it
+                action = ACTION_REPLAN;
+            }
+        }
+    }
+    else if( flags[slot] & HAS_DESTINATION )
+    {
+        // calculate path, then update location
+        action = ACTION_REQUEST_PATH;
+        flags[slot] &= ~HAS_DESTINATION;
+        delays[slot] = 0;
+    }
+    else if( !map->isBuilt(x, y) || map->getMoveCost(x, y) < 0 )
+    {
+        // no path, build the cell or get off it
+        action = ACTION_WORK;
+    }
+
+    // out of work, the job board hears about it in apply()
+    if( action == ACTION_NONE && !(flags[slot] & WAITING_FOR_WORK) && isIdle(slot) )
+        action = ACTION_IDLE;
+
+    actions[slot] = action;
+    return action != ACTION_NONE;
+}
+
+void MoverStore::apply(slot_t slot)
+{
+    switch( actions[slot] )
+    {
+        case ACTION_POLL_PATH:
+            pollPath(slot);
+            break;
+
+        case ACTION_MOVE:
+            moveTo(slot, next_steps[slot].x, next_steps[slot].y);
+            break;
+
+        case ACTION_REPLAN:
+            replanPath(slot);
+            break;
+
+        case ACTION_REQUEST_PATH:
+            requestPath(slot);
+            break;
+
+        case ACTION_WORK:
+            work(slot);
+            break;
+
+        default:
+            break;
+    }
+    actions[slot] = ACTION_NONE;
+
+    // out of work, let the job board know once
+    if( !(flags[slot] & WAITING_FOR_WORK) && isIdle(slot) )
+    {
+        flags[slot] |= WAITING_FOR_WORK;
+        map->getJobBoard().robotIdle(owners[slot]);
+    }
+}
+
+void MoverStore::moveTo(slot_t slot, int x, int y)
+{
+    xs[slot] = x;
+    ys[slot] = y;
+    owners[slot]->moveTo(x, y);
+}
+
+void MoverStore::setDestination(slot_t slot, int x, int y, bool shared)
+{
+    destinations[slot] = CL_Point(x, y);
+
+    // an answer for the old destination is no use now
+    cancelPath(slot);
+
+    // nor is the search towards it
+    delete planners[slot];
+    planners[slot] = NULL;
+
+    flags[slot] |= HAS_DESTINATION;
+    flags[slot] &= ~WAITING_FOR_WORK;
+
+    if( shared )
+        flags[slot] |= SHARED_DESTINATION;
+    else
+        flags[slot] &= ~SHARED_DESTINATION;
+}
+
+void MoverStore::stop(slot_t slot)
+{
+    cancelPath(slot);
+
+    delete planners[slot];
+    planners[slot] = NULL;
+
+    paths[slot].clear();
+    flags[slot] &= ~HAS_DESTINATION;
+}
+
+void MoverStore::cancelPath(slot_t slot)
+{
+    if( tickets[slot] != PathService::NO_TICKET )
+    {
+        map->getPathService().cancel( tickets[slot] );
+        tickets[slot] = PathService::NO_TICKET;
+    }
+}
+
+void MoverStore::getDrawPosition(slot_t slot, double alpha, double &x, double &y)
+{
+    x = xs[slot];
+    y = ys[slot];
+
+    const std::vector<CL_Point> &path = paths[slot];
+    if( tickets[slot] != PathService::NO_TICKET || path.empty() )
+        return;
+
+    // how far through the wait to leave this cell, as of alpha into the
+    // next tick
+    double cost = map->getMoveCost(xs[slot], ys[slot]);
+    if( cost <= 0 )
+        return;
+
+    double t = (delays[slot] + alpha * MOVE_SPEED) / cost;
+    if( t > 1 ) t = 1;
+
+    const CL_Point &next = path.back();
+    x += (next.x - xs[slot]) * t;
+    y += (next.y - ys[slot]) * t;
+}
+
+bool MoverStore::findPath(slot_t slot)
+{
+    const int x = xs[slot], y = ys[slot];
+    const CL_Point &dest = destinations[slot];
+
+	// walled off, don't flood everything we can reach to find out
+	if( !map->isReachable( x, y, dest.x, dest.y ) )
+		return false;
+
+	// many movers share this destination, read its distance field
+	if( flags[slot] & SHARED_DESTINATION )
+		return map->getFlowFields().findPath( x, y, dest.x, dest.y, paths[slot] );
+
+	return map->getPathSearch().findPath( x, y, dest.x, dest.y, paths[slot] );
+}
+
+void MoverStore::requestPath(slot_t slot)
+{
+    const CL_Point &dest = destinations[slot];
+
+	cancelPath(slot);
+
+	if( flags[slot] & SHARED_DESTINATION )
+	{
+		// shared fields are cheap once built, no need to wait for them
+		if( !findPath(slot) )
+		{
+			paths[slot].clear();
+			fprintf(stderr, "Mover: Can't find path from %i, %i to %i, %i\n", xs[slot], ys[slot], dest.x, dest.y );
+		}
+		return;
+	}
+
+	paths[slot].clear();
+	tickets[slot] = map->getPathService().submit( xs[slot], ys[slot], dest.x, dest.y );
+}
+
+void MoverStore::pollPath(slot_t slot)
+{
+    int status = map->getPathService().poll( tickets[slot], paths[slot] );
+    if( status != PathService::PENDING )
+    {
+        tickets[slot] = PathService::NO_TICKET;
+        delays[slot] = 0;
+
+        if( status == PathService::FAILED )
+            fprintf(stderr, "Mover: Can't find path from %i, %i to %i, %i\n", xs[slot], ys[slot], destinations[slot].x, destinations[slot].y );
+    }
+}
+
+void MoverStore::replanPath(slot_t slot)
+{
+	const uint64_t version = map->getCostGrid().getVersion();
+	const CL_Point &dest = destinations[slot];
+	DStarLite *&planner = planners[slot];
+
+	if( !planner )
+	{
+		planner = new DStarLite( &map->getCostGrid() );
+		planner->reset( dest.x, dest.y );
+	}
+	else
+	{
+		// tell the search what changed since it last ran
+		CL_Rect rect;
+		for( uint64_t v = planner_versions[slot] + 1; v <= version; v++ )
+		{
+			if( !map->getChange( v, rect ) || rect.get_width()*rect.get_height() > MAX_REPLAN_CELLS )
+			{
+				// fell too far behind or too much changed, start over
+				planner->reset( dest.x, dest.y );
+				break;
+			}
+
+			for( int y = rect.top; y < rect.bottom; y++ )
+			{
+				for( int x = rect.left; x < rect.right; x++ )
+					planner->cellChanged( x, y );
+			}
+		}
+	}
+	planner_versions[slot] = version;
+
+	if( !map->isReachable( xs[slot], ys[slot], dest.x, dest.y ) ||
+			!planner->findPath( xs[slot], ys[slot], paths[slot] ) )
+	{
+		paths[slot].clear();
+		fprintf(stderr, "Mover: Can't find path from %i, %i to %i, %i\n", xs[slot], ys[slot], dest.x, dest.y );
+	}
+}
+
+void MoverStore::work(slot_t slot)
+{
+	const int cur_x = xs[slot], cur_y = ys[slot];
+
+	// build the cell if we can
+	if( !map->isBuilt( cur_x, cur_y ) )
+	{
+		map->buildCell( cur_x, cur_y, BUILD_SPEED );
+	}
+
+	// is the cell done, and is it an impassible cell?
+	if( map->isBuilt( cur_x, cur_y )
+			&& map->getMoveCost( cur_x, cur_y ) < 0 )
+	{
+		// pick a random cell next to us to move to
+		static const int steps[8][2] =
+		{
+			{ 1, 1 }, { 1, 0 }, { 1, -1 }, { 0, -1 },
+			{ -1, -1 }, { -1, 0 }, { -1, 1 }, { 0, 1 }
+		};
+		const int *step = steps[rand() % 8];
+
+		int x = cur_x + step[0];
+		int y = cur_y + step[1];
+
+		if( x < 0 ) x = 0;
+		if( y < 0 ) y = 0;
+
+		if( x > (int)map->getWidth()-1 )  x = map->getWidth()-1;
+		if( y > (int)map->getHeight()-1 ) y = map->getHeight()-1;
+
+		moveTo(slot, x, y);
+	}
+}
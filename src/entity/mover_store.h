@@ -0,0 +1,199 @@
+/**
+ * File:    mover_store.h
+ *
+ * Author:  Ben Reeves
+ *
+ * State of every mover on a map, one array per component indexed by slot.
+ * The passes made over every mover each tick read the few arrays they need
+ * front to back instead of visiting each mover's object on the heap; Mover
+ * objects are handles onto a slot.
+ */
+
+#ifndef MOVER_STORE_H
+#define MOVER_STORE_H
+
+#include "path/path_service.h"
+
+#include <ClanLib/core.h>
+#include <stdint.h>
+#include <vector>
+
+// progress each tick of the sim clock, at SimClock::TICK_RATE ticks a second
+#define MOVE_SPEED 0.005
+#define BUILD_SPEED	0.01
+
+class Map;
+class Mover;
+class DStarLite;
+
+class MoverStore
+{
+    public:
+        typedef uint32_t slot_t;
+
+        /**
+         * MoverStore(map)
+         *
+         * empty store for the movers on map
+         */
+        MoverStore(Map *map);
+
+        ~MoverStore();
+
+        /**
+         * add(owner, x, y)
+         *
+         * new slot for owner standing at x, y
+         */
+        slot_t add(Mover *owner, int x, int y);
+
+        /**
+         * remove(slot)
+         *
+         * free a slot, dropping any path request and search. The last slot
+         * moves into its place and its owner is told.
+         */
+        void remove(slot_t slot);
+
+        /**
+         * number of slots in use, slots run from 0 to size()-1
+         */
+        size_t size() const { return owners.size(); }
+
+        Mover* getOwner(slot_t slot) const { return owners[slot]; }
+
+        /**
+         * plan(slot)
+         *
+         * first half of a mover's update: works out what to do this tick,
+         * writing only the slot's own components. Any number of slots can
+         * plan at once. Returns true if apply() has something to do.
+         */
+        bool plan(slot_t slot);
+
+        /**
+         * apply(slot)
+         *
+         * second half of a mover's update: carries out the plan, moving on
+         * the map, building and talking to the job board. Slots apply one
+         * at a time.
+         */
+        void apply(slot_t slot);
+
+        /**
+         * setDestination(slot, x, y, shared)
+         *
+         * send the mover to x, y; shared destinations are reached through
+         * the map's flow fields
+         */
+        void setDestination(slot_t slot, int x, int y, bool shared);
+
+        /**
+         * stop(slot)
+         *
+         * forget the destination and any path to it
+         */
+        void stop(slot_t slot);
+
+        /**
+         * isIdle(slot)
+         *
+         * true if the mover has nowhere to go and nothing to build
+         */
+        bool isIdle(slot_t slot);
+
+        /**
+         * getDrawPosition(slot, alpha, x, y)
+         *
+         * where the mover is shown, part way to its next cell alpha of a
+         * tick on from its last update
+         */
+        void getDrawPosition(slot_t slot, double alpha, double &x, double &y);
+
+    private:
+        enum
+        {
+            HAS_DESTINATION     = 1 << 0,
+
+            // other movers are likely heading to the same point
+            SHARED_DESTINATION  = 1 << 1,
+
+            // the job board knows this mover is idle
+            WAITING_FOR_WORK    = 1 << 2
+        };
+
+        // what plan() decided
+        enum
+        {
+            ACTION_NONE,
+            ACTION_POLL_PATH,
+            ACTION_MOVE,
+            ACTION_REPLAN,
+            ACTION_REQUEST_PATH,
+            ACTION_WORK,
+            ACTION_IDLE
+        };
+
+        /**
+         * move the mover, its owner keeps the map's entity index up to date
+         */
+        void moveTo(slot_t slot, int x, int y);
+
+        /**
+         * search for a path to the destination right away
+         */
+        bool findPath(slot_t slot);
+
+        /**
+         * ask for a path to the destination, answered on a later update by
+         * the map's path service
+         */
+        void requestPath(slot_t slot);
+
+        /**
+         * collect the answer to the outstanding path request, if it's ready
+         */
+        void pollPath(slot_t slot);
+
+        /**
+         * repair the path after a cell on it changed, reusing the search
+         * from the last repair towards the same destination
+         */
+        void replanPath(slot_t slot);
+
+        /**
+         * drop the outstanding path request, if any
+         */
+        void cancelPath(slot_t slot);
+
+        /**
+         * build the cell the mover is on, or step off it if it can't be
+         * stood on
+         */
+        void work(slot_t slot);
+
+        Map *map;
+
+        // read by plan() for every mover every tick
+        std::vector<int32_t> xs, ys;
+        std::vector<double> delays;
+        std::vector<uint8_t> flags;
+        std::vector<uint8_t> actions;
+        std::vector<PathService::ticket_t> tickets;
+
+        // path to follow, next step at the back
+        std::vector< std::vector<CL_Point> > paths;
+
+        // only touched when a mover changes what it's doing
+        std::vector<CL_Point> destinations;
+        std::vector<CL_Point> next_steps;
+
+        // incremental search kept while heading for the current destination,
+        // and the cost version it has seen
+        std::vector<DStarLite*> planners;
+        std::vector<uint64_t> planner_versions;
+
+        std::vector<Mover*> owners;
+};
+
+#endif
@@ -6,7 +6,12 @@
  */
 #include "game.h"
 #include "game_window.h"
-#include "entity/mover.h"
+#include "entity/entity.h"
+#include "map/spatial_index.h"
+#include "render/renderer.h"
+#include "sim/simulation.h"
+
+#include <cmath>
 
 #define WIN_WIDTH	1000
 #define WIN_HEIGHT	1000
@@ -14,22 +19,26 @@
 #define MAP_WIDTH	50
 #define MAP_HEIGHT	50
 
+// map loaded at start if it exists, and written by F5
+#define MAP_FILE	"map.rmap"
+
 #define CELL_MIN_SIZE	64
 
 #define CURSOR_BLINK_RATE 10
 
 #define SCROLL_BORDER_WIDTH 20
-#define SCROLL_SPEED	0.1
-
+// pixels a second
+#define SCROLL_SPEED	6.0
 
-// static variables
-CL_Sprite Game::tileset;
+// fast forward steps, and the most it goes
+#define SPEED_STEP		10.0
+#define MAX_SPEED		100.0
 
 
 Game::Game( )
 	: map_origin_x(0), map_origin_y(0), 
 	cur_cell_id(0), 
-	cursor_pos_x(0), cursor_pos_y(0), cursor_blink_rate(CURSOR_BLINK_RATE), cursor_color(CL_Color::white)
+	cursor_pos_x(0), cursor_pos_y(0), paint_x(-1), paint_y(-1), cursor_blink_rate(CURSOR_BLINK_RATE), cursor_color(CL_Color::white)
 {
 	// Setup modules
 	setup_core = new CL_SetupCore;
@@ -62,7 +71,7 @@ Game::Game( )
 	game_frame = new GameWindow( this, top_window );
 
 	// load tileset
-	tileset = CL_Sprite(top_window->get_gc(), "tileset", resources);
+	renderer = new Renderer(top_window->get_gc(), resources);
 
 	// add list view for cell types
 	setup_cell_listview();
@@ -70,14 +79,16 @@ Game::Game( )
 	// setup components
 	resize();
 
-	// create the map
-	map = new Map(MAP_WIDTH, MAP_HEIGHT);
+	// load the saved map, or start a new one
+	map = Map::load(MAP_FILE);
+	if( !map )
+		map = new Map(MAP_WIDTH, MAP_HEIGHT);
+	sim = new Simulation(map);
 	min_cell_size = CELL_MIN_SIZE;
 
     // TODO: remove this
     // create some test entities
-    Mover *m = new Mover(map, 10, 10);
-    robots.push_back(m);
+    sim->addRobot(10, 10);
 
 	// setup input
 	ic = top_window->get_ic();
@@ -134,9 +145,14 @@ void Game::run()
 
 void Game::updateLogic()
 {
+	clock.beginFrame();
+
+	// scrolling goes by real time, whatever the game speed
+	const double scroll = SCROLL_SPEED * clock.getFrameTime();
+
 	// set new cell size
-	cell_width = std::max((double)min_cell_size, (double)window_width/MAP_WIDTH);
-	cell_height = std::max((double)min_cell_size, (double)window_height/MAP_HEIGHT);
+	cell_width = std::max((double)min_cell_size, (double)window_width/map->getWidth());
+	cell_height = std::max((double)min_cell_size, (double)window_height/map->getHeight());
 
 	// mouse position over window
 	int mouse_x = ic.get_mouse().get_x();
@@ -150,20 +166,20 @@ void Game::updateLogic()
 		// X
 		if( mouse_x < frame_geom.left + SCROLL_BORDER_WIDTH && map_origin_x < 0)
 		{
-			map_origin_x+=SCROLL_SPEED;
+			map_origin_x+=scroll;
 		}
 		if( mouse_x > frame_geom.right - SCROLL_BORDER_WIDTH && map_origin_x > (double)window_width - map->getWidth() * cell_width )
 		{
-			map_origin_x-=SCROLL_SPEED;
+			map_origin_x-=scroll;
 		}
 		// Y
 		if( mouse_y < frame_geom.top + SCROLL_BORDER_WIDTH && map_origin_y < 0)
 		{
-			map_origin_y+=SCROLL_SPEED;
+			map_origin_y+=scroll;
 		}
 		if( mouse_y > frame_geom.bottom - SCROLL_BORDER_WIDTH && map_origin_y > (double)window_height - map->getHeight() * cell_height )
 		{
-			map_origin_y-=SCROLL_SPEED;
+			map_origin_y-=scroll;
 		}
 
 		// do bounds checking, in the case of zooming
@@ -180,50 +196,47 @@ void Game::updateLogic()
 		cursor_pos_x = (mouse_x - map_origin_x) / cell_width;
 		cursor_pos_y = (mouse_y - map_origin_y) / cell_height;
 
-		// is the mouse button down, while inside the game frame, and the cell is a different type
+		// is the mouse button down, while inside the game frame
 		if( ic.get_mouse().get_keycode( CL_MOUSE_LEFT ) &&
 			cursor_pos_x >= 0 && (size_t)cursor_pos_x < map->getWidth() &&
 			cursor_pos_y >= 0 && (size_t)cursor_pos_y < map->getHeight() )
 		{
-			if( Cell::Types[cur_cell_id].build_cost == 0 )
-			{
-				if ( map->getCell(cursor_pos_x, cursor_pos_y)->getBaseId() != cur_cell_id )
-				{
-					// cell type change
-					// TODO eventually take into account cost to "build" cell
-					map->setCellBase(cursor_pos_x, cursor_pos_y, cur_cell_id );
-				}
-			}
-			else
+			// TODO eventually take into account cost to "build" cell
+
+			// paint from where the cursor was last frame, so fast drags leave
+			// no gaps
+			if( paint_x < 0 )
 			{
-				if ( map->getCell(cursor_pos_x, cursor_pos_y)->getBuildingId() != cur_cell_id )
-				{
-					// cell type change
-					// TODO eventually take into account cost to "build" cell
-					map->setCellBuilding(cursor_pos_x, cursor_pos_y, cur_cell_id );
-				}
+				paint_x = cursor_pos_x;
+				paint_y = cursor_pos_y;
 			}
-		}
 
-	}
+			map->editLine( paint_x, paint_y, cursor_pos_x, cursor_pos_y, edit_layer(), cur_cell_id );
 
-	map->update();
+			paint_x = cursor_pos_x;
+			paint_y = cursor_pos_y;
+		}
+		else
+		{
+			paint_x = paint_y = -1;
+		}
 
-	if( map->hasChanges() )
+	}
+	else
 	{
-		map->processChanges( robots );
+		paint_x = paint_y = -1;
 	}
 
-	for( Mover *r : robots )
+	while( clock.step() )
 	{
-		r->update();
+		sim->tick();
 	}
 }
 
 void Game::redraw( CL_GraphicContext &gc )
 {
 	// draw the map
-	map->draw( gc, map_origin_x, map_origin_y, cell_width, cell_height, window_width, window_height );
+	renderer->drawMap( gc, *map, map_origin_x, map_origin_y, cell_width, cell_height, window_width, window_height );
 
 	// handle curosr blink color change
 	if( cursor_blink_rate-- == 0 )
@@ -251,10 +264,14 @@ void Game::redraw( CL_GraphicContext &gc )
 		gc.pop_modelview();
 	}
 
-    // update/redraw any entities on the board
-	for( Mover *r : robots )
+    // update/redraw any entities on the board, only those on screen
+	std::vector<Entity*> visible;
+	map->getEntityIndex().queryRect( floor( -map_origin_x / cell_width ), floor( -map_origin_y / cell_height ),
+			ceil( (window_width - map_origin_x) / cell_width ), ceil( (window_height - map_origin_y) / cell_height ), visible );
+
+	for( Entity *e : visible )
 	{
-		r->draw(gc, cell_width, cell_height, map_origin_x, map_origin_y);
+		renderer->drawEntity(gc, *e, cell_width, cell_height, map_origin_x, map_origin_y, clock.getAlpha());
     }
 
 }
@@ -281,8 +298,8 @@ void Game::handle_mouse( const CL_InputEvent &evt, const CL_InputState &state )
 
 		}
 
-		double new_cell_width = std::max((double)min_cell_size, (double)window_width/MAP_WIDTH);
-		double new_cell_height = std::max((double)min_cell_size, (double)window_height/MAP_HEIGHT);
+		double new_cell_width = std::max((double)min_cell_size, (double)window_width/map->getWidth());
+		double new_cell_height = std::max((double)min_cell_size, (double)window_height/map->getHeight());
 
 		double new_frac_x = (double)(mouse_x - map_origin_x) / new_cell_width;
 		double new_frac_y = (double)(mouse_y - map_origin_y) / new_cell_height;
@@ -292,6 +309,14 @@ void Game::handle_mouse( const CL_InputEvent &evt, const CL_InputState &state )
 	}
 }
 
+/*
+ * Part of the cell the selected type is painted on
+ */
+Map::edit_layer_t Game::edit_layer()
+{
+	return Cell::Types[cur_cell_id].build_cost == 0 ? Map::EDIT_BASE : Map::EDIT_BUILDING;
+}
+
 void Game::handle_keyboard( const CL_InputEvent &key, const CL_InputState &state )
 {
 	switch( key.id )
@@ -300,6 +325,33 @@ void Game::handle_keyboard( const CL_InputEvent &key, const CL_InputState &state
 			top_window->exit_with_code(0);
 			break;
 
+		case CL_KEY_F:
+			// fill the region under the cursor
+			if( key.repeat_count > 0 ) return;
+			map->editFill( cursor_pos_x, cursor_pos_y, edit_layer(), cur_cell_id );
+			break;
+
+		case CL_KEY_ADD:
+			// fast forward
+			clock.setSpeed( std::min( clock.getSpeed() * SPEED_STEP, MAX_SPEED ) );
+			printf("Game: Speed %gx\n", clock.getSpeed());
+			break;
+
+		case CL_KEY_SUBTRACT:
+			clock.setSpeed( std::max( clock.getSpeed() / SPEED_STEP, 1.0 ) );
+			printf("Game: Speed %gx\n", clock.getSpeed());
+			break;
+
+		case CL_KEY_P:
+			if( key.repeat_count > 0 ) return;
+			clock.setPaused( !clock.isPaused() );
+			break;
+
+		case CL_KEY_F5:
+			if( map->save(MAP_FILE) )
+				printf("Game: Saved map to %s\n", MAP_FILE);
+			break;
+
 			/* old version
 		case CL_KEY_W: case CL_KEY_UP:
 			if( cursor_pos_y > 0 ) cursor_pos_y--;
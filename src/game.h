@@ -15,7 +15,10 @@
 #include <ClanLib/gui.h>
 
 #include "map/map.h"
-#include "entity/entity.h"
+#include "sim/sim_clock.h"
+
+class Simulation;
+class Renderer;
 
 class GameWindow;
 
@@ -26,12 +29,12 @@ class Game
 
 		void run();
 
+		// once a frame: input, then as many ticks as the clock says are due
 		void updateLogic();
 		void redraw( CL_GraphicContext &gc );
 
 		bool quit( );
 
-		static CL_Sprite& get_tileset() { return tileset; }
 	private:
 
 		// GUI setup
@@ -41,6 +44,9 @@ class Game
 		void handle_mouse( const CL_InputEvent &evt, const CL_InputState &state );
 		void handle_keyboard( const CL_InputEvent &key, const CL_InputState &state );
 		void cell_selection_change( CL_ListViewSelection sel );
+
+		// layer of the map the selected cell type is painted on
+		Map::edit_layer_t edit_layer();
 	    void resize();
 
 		CL_ResourceManager *resources;
@@ -53,7 +59,11 @@ class Game
 
 		CL_InputContext ic;
 
-		// the map of cells
+		// game time, apart from the frame rate
+		SimClock clock;
+
+		// the world, and its map of cells
+		Simulation *sim;
 		Map *map;
 		double map_origin_x;
 		double map_origin_y;
@@ -65,6 +75,9 @@ class Game
 
 		// cursor data
 		int cursor_pos_x, cursor_pos_y;
+
+		// cell painted last frame while the mouse is held, -1 if not painting
+		int paint_x, paint_y;
 		int cursor_blink_rate;
 		CL_Colorf cursor_color;
 
@@ -72,11 +85,7 @@ class Game
 		int window_width, window_height;
 
 		// Graphics
-		static CL_Sprite tileset;
-
-        // list of entities
-		//std::vector<Entity> entities;
-        std::vector<Mover*> robots;
+		Renderer *renderer;
 
 		// slots
 		CL_Slot keyboard_press_slot;
@@ -0,0 +1,241 @@
+/*
+ * File:	game_headless.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Runs the simulation without a display, as fast as it goes. Loads a saved
+ * map or generates one, puts robots and buildings on it, runs a number of
+ * ticks and prints how long they took.
+ *
+ * Usage: game_headless [--map FILE | --size N] [--seed S] [--robots N]
+ *                      [--jobs N] [--ticks N] [--threads N]
+ *                      [--path-threads N] [--format text|json]
+ *
+ * Generated maps are N by N noise terrain from the seed. Jobs are walls and
+ * paths placed on random cells that can be stood on to build them; robots
+ * start on random passable cells.
+ * Robots plan on --threads threads, one per core if 0.
+ *
+ * The checksum covers where every robot ended up and the build state of
+ * the map, so runs that should match can be compared. It does not depend
+ * on --threads. Path threads, two unless --path-threads says otherwise,
+ * hand back paths depending on timing, so only runs with --path-threads 0
+ * repeat exactly.
+ */
+
+#include "map/map.h"
+#include "entity/mover.h"
+#include "job/job_board.h"
+#include "sim/simulation.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// indices into Cell::Types
+#define PATH	3
+#define WALL	4
+
+/*
+ * Small deterministic generator, the same stream on every platform
+ */
+class Random
+{
+	public:
+		Random( uint64_t seed ) : state(seed ? seed : 1) {}
+
+		uint32_t next()
+		{
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			return (uint32_t)(state >> 16);
+		}
+
+		int range( int n ) { return n > 0 ? (int)(next() % (uint32_t)n) : 0; }
+
+	private:
+		uint64_t state;
+};
+
+static double percentile( const std::vector<double> &sorted, double p )
+{
+	if( sorted.empty() ) return 0;
+
+	const size_t i = std::min( sorted.size() - 1, (size_t)(p * sorted.size()) );
+	return sorted[i];
+}
+
+static long peakMemory()
+{
+	struct rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	return usage.ru_maxrss;
+}
+
+/*
+ * FNV-1a over the robots' cells and every cell's build state
+ */
+static uint64_t checksum( Simulation &sim )
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&]( uint64_t v ) {
+		for( int i = 0; i < 8; i++, v >>= 8 )
+		{
+			hash ^= v & 0xff;
+			hash *= 1099511628211ull;
+		}
+	};
+
+	for( Mover *m : sim.getRobots() )
+	{
+		mix( m->getCurrentX() );
+		mix( m->getCurrentY() );
+	}
+
+	Map &map = *sim.getMap();
+	for( size_t y = 0; y < map.getHeight(); y++ )
+	{
+		for( size_t x = 0; x < map.getWidth(); x++ )
+		{
+			const Cell cell = map.getCell( x, y );
+			mix( cell.getBuildingId() );
+			mix( (uint64_t)( cell.getBuildProgress() * BUILD_SCALE ) );
+		}
+	}
+
+	return hash;
+}
+
+static void usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [--map FILE | --size N] [--seed S] [--robots N] [--jobs N]\n"
+			"       [--ticks N] [--threads N] [--path-threads N] [--format text|json]\n", prog );
+}
+
+int main( int argc, char **argv )
+{
+	const char *map_file = NULL;
+	size_t size = 256;
+	uint64_t seed = 1;
+	size_t robots = 1000, jobs = 5000;
+	uint64_t ticks = 10000;
+	int threads = 0, path_threads = -1;
+	bool json = false;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( i + 1 >= argc )
+		{
+			usage( argv[0] );
+			return 1;
+		}
+
+		const char *opt = argv[i], *arg = argv[++i];
+
+		if( !strcmp(opt, "--map") ) map_file = arg;
+		else if( !strcmp(opt, "--size") ) size = strtoul( arg, NULL, 10 );
+		else if( !strcmp(opt, "--seed") ) seed = strtoull( arg, NULL, 10 );
+		else if( !strcmp(opt, "--robots") ) robots = strtoul( arg, NULL, 10 );
+		else if( !strcmp(opt, "--jobs") ) jobs = strtoul( arg, NULL, 10 );
+		else if( !strcmp(opt, "--ticks") ) ticks = strtoull( arg, NULL, 10 );
+		else if( !strcmp(opt, "--threads") ) threads = atoi( arg );
+		else if( !strcmp(opt, "--path-threads") ) path_threads = atoi( arg );
+		else if( !strcmp(opt, "--format") ) json = !strcmp( arg, "json" );
+		else
+		{
+			usage( argv[0] );
+			return 1;
+		}
+	}
+
+	Random rng( seed );
+
+	auto begin = std::chrono::steady_clock::now();
+
+	Map *map = map_file ? Map::load( map_file ) : Map::generate( size, size, rng.next() );
+	if( !map )
+	{
+		fprintf( stderr, "game_headless: can't load %s\n", map_file );
+		return 1;
+	}
+
+	if( path_threads >= 0 )
+		map->setPathThreads( path_threads );
+
+	Simulation sim( map );
+	sim.setThreads( threads );
+	const int w = map->getWidth(), h = map->getHeight();
+
+	for( size_t placed = 0, tries = 0; placed < jobs && tries < 100*jobs; tries++ )
+	{
+		const int x = rng.range( w ), y = rng.range( h );
+
+		// nobody could stand on the cell to build it
+		if( Cell::Types[ map->getCell( x, y ).getBaseId() ].move_cost < 0 ) continue;
+
+		map->setCellBuilding( x, y, rng.range(2) ? WALL : PATH );
+		placed++;
+	}
+
+	for( size_t placed = 0, tries = 0; placed < robots && tries < 100*robots; tries++ )
+	{
+		const int x = rng.range( w ), y = rng.range( h );
+		if( map->getMoveCost( x, y ) < 0 ) continue;
+
+		sim.addRobot( x, y );
+		placed++;
+	}
+
+	const double setup = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+	const size_t work = map->getPendingWork();
+
+	std::vector<double> times;
+	times.reserve( ticks );
+
+	for( uint64_t t = 0; t < ticks; t++ )
+	{
+		auto start = std::chrono::steady_clock::now();
+		sim.tick();
+		times.push_back( std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() );
+	}
+
+	double total = 0;
+	for( double t : times ) total += t;
+
+	std::sort( times.begin(), times.end() );
+
+	const double mean = times.empty() ? 0 : total / times.size();
+	const double p50 = percentile( times, 0.50 ), p99 = percentile( times, 0.99 );
+	const double max = times.empty() ? 0 : times.back();
+	const size_t built = work - std::min( work, map->getPendingWork() );
+	const size_t assigned = map->getJobBoard().getAssigned();
+	const uint64_t hash = checksum( sim );
+
+	if( json )
+	{
+		printf( "{\"width\": %d, \"height\": %d, \"robots\": %zu, \"threads\": %d, \"ticks\": %llu, \"setup_s\": %.3f, "
+				"\"seconds\": %.3f, \"ticks_per_sec\": %.1f, \"mean_ms\": %.4f, \"p50_ms\": %.4f, "
+				"\"p99_ms\": %.4f, \"max_ms\": %.4f, \"jobs\": %zu, \"assigned\": %zu, \"built\": %zu, "
+				"\"peak_kb\": %ld, \"checksum\": \"%016llx\"}\n",
+				w, h, sim.getRobots().size(), sim.getThreads(), (unsigned long long)ticks, setup, total,
+				total > 0 ? ticks / total : 0.0, mean*1000, p50*1000, p99*1000, max*1000,
+				work, assigned, built, peakMemory(), (unsigned long long)hash );
+	}
+	else
+	{
+		printf( "map %dx%d, %zu robots on %d threads, %zu jobs, setup %.3f s\n", w, h, sim.getRobots().size(), sim.getThreads(), work, setup );
+		printf( "%llu ticks in %.3f s, %.1f ticks/s\n", (unsigned long long)ticks, total, total > 0 ? ticks / total : 0.0 );
+		printf( "tick ms: mean %.4f  p50 %.4f  p99 %.4f  max %.4f\n", mean*1000, p50*1000, p99*1000, max*1000 );
+		printf( "jobs assigned %zu, built %zu of %zu, peak %ld kB\n", assigned, built, work, peakMemory() );
+		printf( "checksum %016llx\n", (unsigned long long)hash );
+	}
+
+	return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * File:	job.h
+ *
+ * Author:	James Letendre
+ *
+ * A cell waiting to be built, as tracked by the job board
+ */
+#ifndef JOB_H
+#define JOB_H
+
+#include <stdint.h>
+
+class Mover;
+
+typedef enum
+{
+	/// Waiting for a robot
+	JOB_OPEN,
+
+	/// A robot is on its way or building
+	JOB_CLAIMED,
+
+	/// Built, or the building was taken away; the job is gone after
+	/// listeners hear of it
+	JOB_DONE,
+	JOB_CANCELLED,
+} job_state_t;
+
+typedef struct
+{
+	int x, y;
+
+	/// Higher priority jobs are handed out first
+	int priority;
+
+	job_state_t state;
+
+	/// Robot holding the claim and the tick it claimed the job, NULL if open
+	Mover *robot;
+	uint64_t claimed_at;
+
+	/// Last robot whose claim ran out, not given this job again while other
+	/// robots might take it
+	Mover *timed_out;
+} job_t;
+
+#endif
@@ -0,0 +1,314 @@
+/*
+ * File:	job_board.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Jobs waiting to be built, and the robots that claimed them
+ */
+
+#include "job/job_board.h"
+#include "map/map.h"
+#include "entity/mover.h"
+
+#include <algorithm>
+
+// unclaimed jobs looked at per waiting robot each tick
+#define JOBS_PER_ROBOT		4
+
+// default claim time: waiting on a path, then twice a mover's pace for each
+// unit of the trip's estimated cost
+#define TIMEOUT_BASE		5000
+#define TIMEOUT_PER_COST	(2 / MOVE_SPEED)
+
+JobBoard::JobBoard( Map *map )
+	: map(map), width(map->getWidth()), height(map->getHeight()), dispatcher(map), changed(false),
+	tick(0), timeout_base(TIMEOUT_BASE), timeout_per_cost(TIMEOUT_PER_COST),
+	assigned(0), assigned_cost(0), timed_out(0)
+{
+	for( CL_Point p : map->getPendingCells() )
+		jobOpened( p.x, p.y );
+}
+
+void JobBoard::notify( const job_t &job, event_t event )
+{
+	for( listener_t &l : listeners )
+		l( job, event );
+}
+
+void JobBoard::open( job_t &job )
+{
+	job.state = JOB_OPEN;
+	job.robot = NULL;
+
+	auto level = open_jobs.find( job.priority );
+	if( level == open_jobs.end() )
+		level = open_jobs.insert( std::make_pair( job.priority, DirtySet( width, height ) ) ).first;
+
+	level->second.insert( job.x, job.y );
+	changed = true;
+}
+
+void JobBoard::unlist( job_t &job )
+{
+	auto level = open_jobs.find( job.priority );
+	if( level == open_jobs.end() ) return;
+
+	level->second.erase( job.x, job.y );
+	if( level->second.empty() )
+		open_jobs.erase( level );
+}
+
+void JobBoard::jobOpened( int x, int y )
+{
+	const uint32_t cell = key( x, y );
+	if( jobs.count( cell ) ) return;
+
+	job_t &job = jobs[cell];
+	job.x = x;
+	job.y = y;
+	job.priority = 0;
+	job.claimed_at = 0;
+	job.timed_out = NULL;
+
+	open( job );
+	notify( job, EVENT_CREATED );
+}
+
+void JobBoard::jobEnded( int x, int y, bool built )
+{
+	auto found = jobs.find( key( x, y ) );
+	if( found == jobs.end() ) return;
+
+	job_t &job = found->second;
+	Mover *robot = job.robot;
+
+	if( job.state == JOB_OPEN )
+		unlist( job );
+	else
+		claims.erase( robot );
+
+	// a waiting robot may have been busy building this one
+	changed = true;
+
+	job.state = built ? JOB_DONE : JOB_CANCELLED;
+	notify( job, built ? EVENT_FINISHED : EVENT_CANCELLED );
+	jobs.erase( found );
+
+	// nothing left to do there
+	if( robot && !built )
+		robot->stop();
+}
+
+/*
+ * Claim a job for a robot and send it on its way
+ */
+void JobBoard::claim( job_t &job, Mover *robot, double cost )
+{
+	unlist( job );
+
+	job.state = JOB_CLAIMED;
+	job.robot = robot;
+	job.claimed_at = tick;
+	claims[robot] = key( job.x, job.y );
+
+	setDeadline( job, cost );
+
+	assigned++;
+	assigned_cost += cost;
+
+	// a job has one robot, so nobody shares its flow field; the trip goes
+	// to the path service's workers instead
+	robot->setDestination( job.x, job.y, false );
+	notify( job, EVENT_CLAIMED );
+}
+
+/*
+ * Time for the rest of the trip, then for what is left of the building
+ */
+void JobBoard::setDeadline( const job_t &job, double cost )
+{
+	const Cell cell = map->getCell( job.x, job.y );
+	const double progress = cell.getBuildProgress();
+
+	double build = 0;
+	if( cell.getBuildingId() >= 0 )
+		build = (1 - progress) * Cell::Types[cell.getBuildingId()].build_cost / BUILD_SPEED;
+
+	deadline_t d = { tick + timeout_base + (uint64_t)(cost * timeout_per_cost + build), key( job.x, job.y ), job.claimed_at,
+		job.robot->getCurrentX(), job.robot->getCurrentY(), progress };
+	deadlines.push( d );
+}
+
+/*
+ * Put a claimed job back up for grabs
+ */
+void JobBoard::release( job_t &job )
+{
+	claims.erase( job.robot );
+	open( job );
+	notify( job, EVENT_RELEASED );
+}
+
+void JobBoard::robotIdle( Mover *robot )
+{
+	// idle without finishing, so it couldn't get there
+	auto held = claims.find( robot );
+	if( held != claims.end() )
+		release( jobs[held->second] );
+
+	if( waiting_set.insert( robot ).second )
+		waiting.push_back( robot );
+
+	changed = true;
+}
+
+void JobBoard::robotRemoved( Mover *robot )
+{
+	auto held = claims.find( robot );
+	if( held != claims.end() )
+		release( jobs[held->second] );
+
+	if( waiting_set.erase( robot ) )
+		waiting.erase( std::find( waiting.begin(), waiting.end(), robot ) );
+
+	// only robots whose claims ran out are worth looking through every job for
+	if( timed_out_robots.erase( robot ) )
+	{
+		for( auto &j : jobs )
+		{
+			if( j.second.timed_out == robot ) j.second.timed_out = NULL;
+		}
+	}
+}
+
+void JobBoard::update()
+{
+	tick++;
+
+	// claims that ran out, robots stuck on the way give their job to others
+	while( !deadlines.empty() && deadlines.top().tick <= tick )
+	{
+		const deadline_t d = deadlines.top();
+		deadlines.pop();
+
+		auto found = jobs.find( d.cell );
+		if( found == jobs.end() ) continue;
+
+		job_t &job = found->second;
+		if( job.state != JOB_CLAIMED || job.claimed_at != d.claimed_at ) continue;
+
+		Mover *robot = job.robot;
+
+		// slower than estimated, but still getting there
+		if( robot->getCurrentX() != d.x || robot->getCurrentY() != d.y ||
+				map->getCell( job.x, job.y ).getBuildProgress() > d.progress )
+		{
+			setDeadline( job, dispatcher.estimate( robot, &job ) );
+			continue;
+		}
+
+		job.timed_out = robot;
+		timed_out_robots.insert( robot );
+		timed_out++;
+
+		release( job );
+		robot->stop();
+	}
+
+	// nothing new since robots last came away empty handed
+	if( !changed || waiting.empty() || open_jobs.empty() ) return;
+	changed = false;
+
+	// robots sent elsewhere since they asked sit this one out
+	std::vector<Mover*> robots;
+	for( Mover *m : waiting )
+	{
+		if( m->isIdle() )
+			robots.push_back( m );
+	}
+
+	// highest priority, then oldest, jobs first
+	const size_t batch = JOBS_PER_ROBOT * robots.size();
+	std::vector<job_t*> batch_jobs;
+
+	for( auto &level : open_jobs )
+	{
+		for( CL_Point p : level.second )
+		{
+			batch_jobs.push_back( &jobs[key( p.x, p.y )] );
+			if( batch_jobs.size() >= batch ) break;
+		}
+		if( batch_jobs.size() >= batch ) break;
+	}
+
+	const bool more_jobs = batch_jobs.size() >= batch;
+
+	std::vector<JobDispatcher::assignment_t> out;
+	dispatcher.match( robots, batch_jobs, out );
+
+	for( const JobDispatcher::assignment_t &a : out )
+	{
+		waiting_set.erase( a.robot );
+		claim( *a.job, a.robot, a.cost );
+	}
+
+	// nobody else took a job its timed out robot was kept from, let that
+	// robot have another go rather than leave the job open for good
+	std::unordered_set<Mover*> unmatched;
+	for( job_t *job : batch_jobs )
+	{
+		if( !job->timed_out ) continue;
+
+		if( unmatched.empty() )
+			unmatched.insert( robots.begin(), robots.end() );
+
+		if( unmatched.count( job->timed_out ) )
+		{
+			job->timed_out = NULL;
+			changed = true;
+		}
+	}
+
+	size_t n = 0;
+	for( size_t i = 0; i < waiting.size(); i++ )
+	{
+		if( waiting_set.count( waiting[i] ) ) waiting[n++] = waiting[i];
+	}
+	waiting.resize( n );
+
+	// robots left over may still find work past this batch
+	if( !out.empty() && !waiting.empty() && more_jobs )
+		changed = true;
+}
+
+bool JobBoard::setPriority( int x, int y, int priority )
+{
+	auto found = jobs.find( key( x, y ) );
+	if( found == jobs.end() ) return false;
+
+	job_t &job = found->second;
+	if( job.priority == priority ) return true;
+
+	if( job.state == JOB_OPEN )
+	{
+		unlist( job );
+		job.priority = priority;
+		open( job );
+	}
+	else
+		job.priority = priority;
+
+	return true;
+}
+
+const job_t* JobBoard::getJob( int x, int y ) const
+{
+	auto found = jobs.find( key( x, y ) );
+	return found == jobs.end() ? NULL : &found->second;
+}
+
+void JobBoard::setTimeout( uint64_t base, double per_cost )
+{
+	timeout_base = base;
+	timeout_per_cost = per_cost;
+}
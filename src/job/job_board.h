@@ -0,0 +1,185 @@
+/*
+ * File:	job_board.h
+ *
+ * Author:	James Letendre
+ *
+ * Every cell waiting to be built, as a job that robots claim and release.
+ * The map posts jobs as cells change and robots report in when they run out
+ * of work, so a tick only costs what changed since the last one: claims that
+ * ran out, and robots waiting while there is open work for them.
+ */
+#ifndef JOB_BOARD_H
+#define JOB_BOARD_H
+
+#include "job/job.h"
+#include "job/job_dispatcher.h"
+#include "map/dirty_set.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <functional>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Map;
+class Mover;
+
+class JobBoard
+{
+	public:
+		typedef enum
+		{
+			EVENT_CREATED,
+			EVENT_CLAIMED,
+
+			/// Back to open, the robot gave up or its claim timed out
+			EVENT_RELEASED,
+
+			EVENT_FINISHED,
+			EVENT_CANCELLED,
+		} event_t;
+
+		typedef std::function<void(const job_t &job, event_t event)> listener_t;
+
+		/**
+		 * JobBoard(map)
+		 *
+		 * Board for the jobs on map, starting with the cells already waiting
+		 */
+		JobBoard( Map *map );
+
+		/**
+		 * A cell needs building
+		 */
+		void jobOpened( int x, int y );
+
+		/**
+		 * A cell no longer needs building, built if it was finished rather
+		 * than its building taken away
+		 */
+		void jobEnded( int x, int y, bool built );
+
+		/**
+		 * A robot has nothing to do, giving up any job it still holds
+		 */
+		void robotIdle( Mover *robot );
+
+		/**
+		 * Forget a robot about to go away
+		 */
+		void robotRemoved( Mover *robot );
+
+		/**
+		 * One tick: end claims that ran out of time, then hand open jobs to
+		 * waiting robots
+		 */
+		void update();
+
+		/**
+		 * Change a job's priority, false if the cell has no job
+		 */
+		bool setPriority( int x, int y, int priority );
+
+		/**
+		 * The job for a cell, NULL if none
+		 */
+		const job_t* getJob( int x, int y ) const;
+
+		/**
+		 * Call listener as jobs are created, claimed, released and end
+		 */
+		void addListener( listener_t listener ) { listeners.push_back( listener ); }
+
+		/**
+		 * A claim runs out after base ticks plus per_cost ticks for each unit
+		 * of the trip's estimated cost, plus the time left to build. Robots
+		 * still moving or building when it runs out get as long again from
+		 * where they are.
+		 */
+		void setTimeout( uint64_t base, double per_cost );
+
+		size_t getOpen() const { return jobs.size() - claims.size(); }
+		size_t getClaimed() const { return claims.size(); }
+		size_t getWaiting() const { return waiting.size(); }
+
+		/**
+		 * Claims made so far, their total estimated cost, and how many ran
+		 * out of time
+		 */
+		size_t getAssigned() const { return assigned; }
+		double getAssignedCost() const { return assigned_cost; }
+		size_t getTimedOut() const { return timed_out; }
+
+	private:
+		typedef struct
+		{
+			uint64_t tick;
+			uint32_t cell;
+
+			/// Tick of the claim it was set for, older claims are gone
+			uint64_t claimed_at;
+
+			/// Where the robot was and how far the building had got when it
+			/// was set, to tell a slow robot from a stuck one
+			int x, y;
+			double progress;
+		} deadline_t;
+
+		struct later
+		{
+			bool operator()( const deadline_t &a, const deadline_t &b ) const { return a.tick > b.tick; }
+		};
+
+		uint32_t key( int x, int y ) const { return y*width + x; }
+
+		/// List an open job under its priority
+		void open( job_t &job );
+		void unlist( job_t &job );
+
+		void claim( job_t &job, Mover *robot, double cost );
+
+		/// Set the deadline for the claim on job, cost is the rest of the trip
+		void setDeadline( const job_t &job, double cost );
+		void release( job_t &job );
+
+		void notify( const job_t &job, event_t event );
+
+		Map *map;
+		size_t width, height;
+
+		JobDispatcher dispatcher;
+
+		/// Every job by cell, and the open ones by priority, highest first
+		/// and oldest first within a priority
+		std::unordered_map<uint32_t, job_t> jobs;
+		std::map< int, DirtySet, std::greater<int> > open_jobs;
+
+		/// Job held by each robot with a claim, by cell
+		std::unordered_map<Mover*, uint32_t> claims;
+		std::priority_queue<deadline_t, std::vector<deadline_t>, later> deadlines;
+
+		/// Robots looking for work, in the order they asked
+		std::vector<Mover*> waiting;
+		std::unordered_set<Mover*> waiting_set;
+
+		/// Robots that may still be some job's timed_out
+		std::unordered_set<Mover*> timed_out_robots;
+
+		/// Something happened that could let a waiting robot find work
+		bool changed;
+
+		uint64_t tick;
+		uint64_t timeout_base;
+		double timeout_per_cost;
+
+		std::vector<listener_t> listeners;
+
+		size_t assigned;
+		double assigned_cost;
+		size_t timed_out;
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * File:	job_dispatcher.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Matches robots looking for work with open jobs
+ */
+
+#include "job/job_dispatcher.h"
+#include "map/map.h"
+#include "map/spatial_index.h"
+#include "entity/mover.h"
+#include "path/grid_moves.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+// nearest free robots considered for each job
+#define ROBOTS_PER_JOB		4
+
+// up to this many robot and job pairs are all costed, more go through the
+// map's entity index
+#define MAX_ALL_PAIRS		(1 << 16)
+
+// matching rounds per call, robots whose candidate jobs all went to others
+// try again against what is left
+#define MAX_ROUNDS			4
+
+JobDispatcher::JobDispatcher( Map *map )
+	: map(map)
+{
+}
+
+void JobDispatcher::match( std::vector<Mover*> &robots, std::vector<job_t*> &jobs, std::vector<assignment_t> &out )
+{
+	for( int round = 0; round < MAX_ROUNDS && !jobs.empty() && !robots.empty(); round++ )
+	{
+		if( matchRound( robots, jobs, out ) == 0 ) break;
+	}
+}
+
+double JobDispatcher::estimate( Mover *robot, const job_t *job ) const
+{
+	const int dx = robot->getCurrentX() - job->x;
+	const int dy = robot->getCurrentY() - job->y;
+
+	return octile_distance( dx, dy ) * map->getCostGrid().getMinCost();
+}
+
+/*
+ * Cost the likely pairs, then take them highest priority and cheapest first
+ * while both the job and the robot are still free
+ */
+size_t JobDispatcher::matchRound( std::vector<Mover*> &robots, std::vector<job_t*> &jobs, std::vector<assignment_t> &out )
+{
+	std::vector<pairing_t> pairs;
+
+	auto consider = [&]( size_t j, size_t r ) {
+		Mover *m = robots[r];
+		const job_t *job = jobs[j];
+
+		// robots never go straight back to a job they timed out on, and
+		// jobs nobody can reach wait until somebody can
+		if( job->timed_out == m ) return;
+		if( !map->isReachable( m->getCurrentX(), m->getCurrentY(), job->x, job->y ) ) return;
+
+		pairing_t p = { job->priority, estimate( m, job ), j, r };
+		pairs.push_back( p );
+	};
+
+	if( robots.size() * jobs.size() <= MAX_ALL_PAIRS )
+	{
+		for( size_t j = 0; j < jobs.size(); j++ )
+			for( size_t r = 0; r < robots.size(); r++ )
+				consider( j, r );
+	}
+	else
+	{
+		// only the few robots nearest each job are worth costing
+		std::unordered_map<Entity*, size_t> robot_index;
+		for( size_t r = 0; r < robots.size(); r++ )
+			robot_index[robots[r]] = r;
+
+		auto is_free = [&]( Entity *e ) { return robot_index.count( e ) > 0; };
+
+		std::vector<Entity*> nearest;
+		for( size_t j = 0; j < jobs.size(); j++ )
+		{
+			map->getEntityIndex().nearest( jobs[j]->x, jobs[j]->y, ROBOTS_PER_JOB, nearest, is_free );
+
+			for( Entity *e : nearest )
+				consider( j, robot_index[e] );
+		}
+	}
+
+	std::sort( pairs.begin(), pairs.end(), []( const pairing_t &a, const pairing_t &b ) {
+		if( a.priority != b.priority ) return a.priority > b.priority;
+		if( a.cost != b.cost ) return a.cost < b.cost;
+		if( a.job != b.job ) return a.job < b.job;
+		return a.robot < b.robot;
+	});
+
+	std::vector<bool> job_taken( jobs.size(), false ), robot_taken( robots.size(), false );
+	size_t matched = 0;
+
+	for( const pairing_t &p : pairs )
+	{
+		if( job_taken[p.job] || robot_taken[p.robot] ) continue;
+
+		job_taken[p.job] = robot_taken[p.robot] = true;
+		matched++;
+
+		assignment_t a = { jobs[p.job], robots[p.robot], p.cost };
+		out.push_back( a );
+	}
+
+	// keep what is left for the next round
+	size_t n = 0;
+	for( size_t j = 0; j < jobs.size(); j++ )
+	{
+		if( !job_taken[j] ) jobs[n++] = jobs[j];
+	}
+	jobs.resize( n );
+
+	n = 0;
+	for( size_t r = 0; r < robots.size(); r++ )
+	{
+		if( !robot_taken[r] ) robots[n++] = robots[r];
+	}
+	robots.resize( n );
+
+	return matched;
+}
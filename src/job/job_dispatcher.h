@@ -0,0 +1,67 @@
+/*
+ * File:	job_dispatcher.h
+ *
+ * Author:	James Letendre
+ *
+ * Matches robots looking for work with open jobs. Higher priority jobs go
+ * first, and within a priority the cheapest estimated trips, so robots take
+ * the work around them rather than crossing the map for it.
+ */
+#ifndef JOB_DISPATCHER_H
+#define JOB_DISPATCHER_H
+
+#include "job/job.h"
+
+#include <stdlib.h>
+#include <vector>
+
+class Map;
+class Mover;
+
+class JobDispatcher
+{
+	public:
+		typedef struct
+		{
+			job_t *job;
+			Mover *robot;
+
+			/// Estimated cost of the trip
+			double cost;
+		} assignment_t;
+
+		/**
+		 * JobDispatcher(map)
+		 *
+		 * Dispatcher for robots and jobs on map
+		 */
+		JobDispatcher( Map *map );
+
+		/**
+		 * Pair robots with jobs, appending the pairs to out. Paired robots
+		 * and jobs are removed from the lists, which otherwise keep their
+		 * order; robots and jobs listed first win ties.
+		 */
+		void match( std::vector<Mover*> &robots, std::vector<job_t*> &jobs, std::vector<assignment_t> &out );
+
+		/**
+		 * Estimated cost of a robot travelling to a job, never more than the
+		 * cheapest path there
+		 */
+		double estimate( Mover *robot, const job_t *job ) const;
+
+	private:
+		typedef struct
+		{
+			int priority;
+			double cost;
+			size_t job, robot;
+		} pairing_t;
+
+		/// One round of cheapest first matching, returns the number paired
+		size_t matchRound( std::vector<Mover*> &robots, std::vector<job_t*> &jobs, std::vector<assignment_t> &out );
+
+		Map *map;
+};
+
+#endif
@@ -7,13 +7,13 @@
  */
 
 #include "cell.h"
-#include "game.h"
 #include "tileset.h"
 #include <ClanLib/core.h>
 
-#define MIN_BUILD_ALPHA	0.3
+#include <algorithm>
+#include <cmath>
 
-#define CELL_TYPE(x, id, c, b)	 {std::string(#x), id, (c), (b)} 
+#define CELL_TYPE(x, id, c, b)	 {#x, id, (c), (b), (uint16_t)((b)*BUILD_SCALE)} 
 const Cell::cell_type Cell::Types[] = 
 {
 	//
@@ -51,7 +51,7 @@ void Cell::setBaseId( int id )
 
 void Cell::setBuildingId( int id )
 {
-	improve_id = id;
+	improve_id = id < 0 ? NO_BUILDING : id;
 	/*
 	if( improve_id != -1 )
 		build_amount = Cell::Types[id].build_cost;
@@ -60,43 +60,23 @@ void Cell::setBuildingId( int id )
 		build_amount = 0;
 }
 
-/*
- * draw(gc)
- *
- * Draw this cell
- */
-void Cell::draw( CL_GraphicContext &gc, double width, double height, int idx ) const
+void Cell::build( double speed )
 {
-	double build_percent = (build_amount / Cell::Types[improve_id].build_cost) * ( 1.0 - MIN_BUILD_ALPHA ) + MIN_BUILD_ALPHA;
-
-	CL_Sprite &sprite( Game::get_tileset() );
+	if( isBuilt() ) return;
 
-	// Draw the base tile
-	sprite.set_frame( getBaseType() );
-	sprite.set_scale( width/TILESET_SIZE, height/TILESET_SIZE );
-	sprite.set_alpha( 1.0 );
-	sprite.draw( gc, 0, 0 );
-
-	// if there is an improvement, draw that too
-	if( !hasBuilding() || idx >= sprite.get_frame_count() ) return;
-
-	sprite.set_frame( idx );
-	sprite.set_scale( width/TILESET_SIZE, height/TILESET_SIZE );
-	sprite.set_alpha( build_percent );
-	sprite.draw( gc, 0, 0 );
+	// stop at the cost so the count never overflows
+	const long steps = build_amount + lround( speed * BUILD_SCALE );
+	build_amount = std::max( 0L, std::min( steps, (long)Cell::Types[improve_id].build_steps ) );
 }
 
-void Cell::build( double speed )
+double Cell::getBuildProgress() const
 {
-	if( !isBuilt() )
-		build_amount += speed;
+	if( !hasBuilding() || Cell::Types[improve_id].build_steps == 0 ) return 1;
+
+	return (double)build_amount / Cell::Types[improve_id].build_steps;
 }
 
 double Cell::getMoveCost() const
 { 
-	int id = base_id;
-	if( improve_id != -1 && isBuilt() )
-		id = improve_id;
-
-	return Cell::Types[id].move_cost; 
+	return Cell::Types[getSurfaceId()].move_cost; 
 }
@@ -8,18 +8,24 @@
 #ifndef CELL_H
 #define CELL_H
 
-#include <ClanLib/display.h>
+#include <stdint.h>
 #include <string.h>
 
+// build progress is kept in steps of 1/BUILD_SCALE
+#define BUILD_SCALE	1000
+
 class Cell
 {
 	public:
 		typedef struct
 		{
-			const std::string name;
+			const char *name;
 			const int type;
 			const double move_cost;
 			const double build_cost;
+
+			/// build_cost in steps of build progress
+			const uint16_t build_steps;
 		} cell_type;
 
 		static const cell_type Types[];
@@ -49,20 +55,13 @@ class Cell
 		/**
 		 * Get the type of the improvement to this cell
 		 */
-		int getBuildingId() const { return improve_id; }
+		int getBuildingId() const { return improve_id == NO_BUILDING ? -1 : improve_id; }
 
 		/**
 		 * Set the type of the improvement in the cell
 		 */
 		void setBuildingId( int id );
 
-		/*
-		 * draw(gc)
-		 *
-		 * Draw this cell
-		 */
-		void draw( CL_GraphicContext &gc, double width, double height, int idx ) const ;
-
 		/*
 		 * return the cell base type
 		 */
@@ -71,17 +70,22 @@ class Cell
 		/**
 		 * Does this cell have a building
 		 */
-		bool hasBuilding() const { return improve_id != -1; }
+		bool hasBuilding() const { return improve_id != NO_BUILDING; }
 		/*
 		 * return the cell improvement type
 		 */
-		int getBuildingType() const { return improve_id == -1 ? 0 : Cell::Types[improve_id].type; }
+		int getBuildingType() const { return improve_id == NO_BUILDING ? 0 : Cell::Types[improve_id].type; }
 
 		/*
 		 * Get the cost of movement through this cell
 		 */
 		double getMoveCost() const;
 
+		/*
+		 * Get the type whose move cost applies, the building once it is built
+		 */
+		int getSurfaceId() const { return ( improve_id != NO_BUILDING && isBuilt() ) ? improve_id : base_id; }
+
 		/*
 		 * Contribute to building this cell
 		 */
@@ -90,7 +94,12 @@ class Cell
 		/*
 		 * Is this cell built?
 		 */
-		bool isBuilt() const { return improve_id == -1 || build_amount >= Cell::Types[improve_id].build_cost; }
+		bool isBuilt() const { return improve_id == NO_BUILDING || build_amount >= Cell::Types[improve_id].build_steps; }
+
+		/*
+		 * How much of the building is done, 0 to 1
+		 */
+		double getBuildProgress() const;
 
 		/*
 		 * TODO: More functionality
@@ -98,11 +107,14 @@ class Cell
 
 
 	private:
-		// The type of this cell
-		int base_id, improve_id;
+		/// improve_id of a cell without a building
+		static const uint8_t NO_BUILDING = 0xff;
+
+		// The type of this cell, packed so a cell fits in 4 bytes
+		uint8_t base_id, improve_id;
 
-		// the amount built this cell is
-		double build_amount;
+		// the amount built this cell is, in steps of 1/BUILD_SCALE
+		uint16_t build_amount;
 };
 
 #endif
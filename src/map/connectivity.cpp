@@ -0,0 +1,395 @@
+/*
+ * File:	connectivity.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Connected components of the passable cells
+ */
+
+#include "map/connectivity.h"
+#include "map/cost_grid.h"
+#include "path/grid_moves.h"
+
+#include <algorithm>
+
+// ring of neighbours in order around a cell, orthogonals at even positions
+static const int ring[8][2] = {
+	{ 0, -1}, { 1, -1}, { 1,  0}, { 1,  1},
+	{ 0,  1}, {-1,  1}, {-1,  0}, {-1, -1},
+};
+
+// at most this many separate groups of neighbours around one cell
+#define MAX_SIDES	4
+
+// a split flooding more than 1/SPLIT_FRACTION of the map gives up and
+// relabels it whole, which is several times cheaper per cell
+#define SPLIT_FRACTION	4
+
+const uint32_t Connectivity::NO_COMPONENT;
+
+static int findSide( int *sides, int s )
+{
+	while( sides[s] != s )
+	{
+		// halve the chain on the way, a big edit joins thousands of sides
+		sides[s] = sides[sides[s]];
+		s = sides[s];
+	}
+	return s;
+}
+
+Connectivity::Connectivity( const CostGrid *grid )
+	: grid(grid), width(grid->getWidth()), height(grid->getHeight()), generation(0)
+{
+	rebuild();
+}
+
+bool Connectivity::passable( int x, int y ) const
+{
+	return x >= 0 && y >= 0 && (size_t)x < width && (size_t)y < height && grid->get(x, y) >= 0;
+}
+
+uint32_t Connectivity::find( uint32_t label )
+{
+	while( parents[label] != label )
+	{
+		parents[label] = parents[parents[label]];
+		label = parents[label];
+	}
+	return label;
+}
+
+uint32_t Connectivity::newLabel()
+{
+	parents.push_back( parents.size() );
+	return parents.size() - 1;
+}
+
+/*
+ * Flood every component from scratch
+ */
+void Connectivity::rebuild()
+{
+	labels.assign( width*height, NO_COMPONENT );
+	parents.assign( 1, NO_COMPONENT );
+	cells_relabelled = 0;
+
+	std::vector<uint32_t> stack;
+
+	for( size_t i = 0; i < width*height; i++ )
+	{
+		if( labels[i] != NO_COMPONENT || !passable( i % width, i / width ) ) continue;
+
+		const uint32_t label = newLabel();
+		labels[i] = label;
+		stack.push_back( i );
+
+		while( !stack.empty() )
+		{
+			const uint32_t cell = stack.back();
+			stack.pop_back();
+
+			const int x = cell % width, y = cell / width;
+			for( int n = 0; n < NUM_SUCCESSORS; n++ )
+			{
+				const int nx = x + successors[n].dx, ny = y + successors[n].dy;
+				if( !passable( nx, ny ) ) continue;
+
+				const uint32_t next = ny*width + nx;
+				if( labels[next] != NO_COMPONENT ) continue;
+
+				labels[next] = label;
+				stack.push_back( next );
+			}
+		}
+	}
+}
+
+/*
+ * Join or split the components around a cell
+ */
+void Connectivity::cellChanged( size_t x, size_t y )
+{
+	if( x >= width || y >= height ) return;
+
+	const uint32_t index = y*width + x;
+	const bool was_passable = labels[index] != NO_COMPONENT;
+	const bool now_passable = passable( x, y );
+
+	if( was_passable == now_passable ) return;
+
+	// labels only ever grow, start over once they have far outgrown the map
+	if( parents.size() > 2*width*height + 64 )
+	{
+		rebuild();
+		return;
+	}
+
+	if( now_passable )
+		cellOpened( x, y );
+	else
+	{
+		labels[index] = NO_COMPONENT;
+		cellClosed( x, y );
+	}
+}
+
+/*
+ * Open cells first, joining what they touch, then split what the closed ones
+ * may have cut in one flood
+ */
+void Connectivity::cellsChanged( const std::vector<CL_Point> &cells )
+{
+	if( parents.size() > 2*width*height + 64 )
+	{
+		rebuild();
+		return;
+	}
+
+	std::vector<uint32_t> seeds;
+
+	for( const CL_Point &p : cells )
+	{
+		if( p.x < 0 || p.y < 0 || (size_t)p.x >= width || (size_t)p.y >= height ) continue;
+
+		const uint32_t index = p.y*width + p.x;
+		const bool was_passable = labels[index] != NO_COMPONENT;
+		const bool now_passable = passable( p.x, p.y );
+
+		if( was_passable == now_passable ) continue;
+
+		if( now_passable )
+		{
+			cellOpened( p.x, p.y );
+			continue;
+		}
+
+		labels[index] = NO_COMPONENT;
+		for( int n = 0; n < NUM_SUCCESSORS; n++ )
+		{
+			const int nx = p.x + successors[n].dx, ny = p.y + successors[n].dy;
+			if( passable( nx, ny ) ) seeds.push_back( ny*width + nx );
+		}
+	}
+
+	// closed cells later in the list may have been taken as seeds
+	std::sort( seeds.begin(), seeds.end() );
+	seeds.erase( std::unique( seeds.begin(), seeds.end() ), seeds.end() );
+	seeds.erase( std::remove_if( seeds.begin(), seeds.end(), [this]( uint32_t c ) {
+		return !passable( c % width, c / width );
+	}), seeds.end() );
+
+	if( seeds.size() > 1 )
+		split( &seeds[0], seeds.size() );
+}
+
+/*
+ * Everything next to a newly passable cell is now one component
+ */
+void Connectivity::cellOpened( int x, int y )
+{
+	uint32_t label = NO_COMPONENT;
+
+	for( int n = 0; n < NUM_SUCCESSORS; n++ )
+	{
+		const int nx = x + successors[n].dx, ny = y + successors[n].dy;
+		if( !passable( nx, ny ) ) continue;
+
+		const uint32_t other = labels[ny*width + nx];
+		if( other == NO_COMPONENT ) continue;
+
+		const uint32_t root = find( other );
+		if( label == NO_COMPONENT ) label = root;
+		else if( root != label ) parents[root] = label;
+	}
+
+	if( label == NO_COMPONENT ) label = newLabel();
+
+	labels[y*width + x] = label;
+}
+
+/*
+ * A passable cell was closed, which may have cut its component in two
+ */
+void Connectivity::cellClosed( int x, int y )
+{
+	// group the passable neighbours that still touch each other around the
+	// cell, neighbouring ring positions touch and so do orthogonals a corner
+	// apart
+	bool open[8];
+	int sides[8];
+	for( int i = 0; i < 8; i++ )
+	{
+		open[i] = passable( x + ring[i][0], y + ring[i][1] );
+		sides[i] = i;
+	}
+
+	for( int i = 0; i < 8; i++ )
+	{
+		if( !open[i] ) continue;
+
+		const int next = (i + 1) % 8;
+		if( open[next] ) sides[findSide(sides, next)] = findSide( sides, i );
+
+		const int corner = (i + 2) % 8;
+		if( i % 2 == 0 && open[corner] ) sides[findSide(sides, corner)] = findSide( sides, i );
+	}
+
+	uint32_t seeds[MAX_SIDES];
+	int num_seeds = 0;
+	for( int i = 0; i < 8; i++ )
+	{
+		if( open[i] && findSide(sides, i) == i )
+			seeds[num_seeds++] = (y + ring[i][1])*width + x + ring[i][0];
+	}
+
+	// still one piece around the cell, so still one piece
+	if( num_seeds <= 1 ) return;
+
+	split( seeds, num_seeds );
+}
+
+/*
+ * Flood from each seed in turn, a cell at a time. Floods that meet are the
+ * same component; a seed whose floods run out before meeting the rest has
+ * been cut off and gets a label of its own. The last seed left keeps the old
+ * label, so the larger part is never walked in full. A cut through the
+ * middle of the map is cheaper to relabel from scratch.
+ */
+void Connectivity::split( const uint32_t *seeds, int num_seeds )
+{
+	if( stamps.size() != labels.size() )
+	{
+		stamps.assign( labels.size(), 0 );
+		owners.assign( labels.size(), 0 );
+		generation = 0;
+	}
+
+	if( ++generation == 0 )
+	{
+		stamps.assign( labels.size(), 0 );
+		generation = 1;
+	}
+
+	std::vector< std::vector<uint32_t> > queues( num_seeds );
+	std::vector<size_t> heads( num_seeds );
+	std::vector<int> joined( num_seeds );
+	std::vector<bool> busy( num_seeds );
+
+	// seeds with cells left to flood, and pieces not yet found cut off;
+	// only these are visited each round, however many seeds there were
+	std::vector<int> flooding, pieces;
+
+	for( int s = 0; s < num_seeds; s++ )
+	{
+		queues[s].push_back( seeds[s] );
+		heads[s] = 0;
+		joined[s] = s;
+
+		stamps[seeds[s]] = generation;
+		owners[seeds[s]] = s;
+
+		flooding.push_back( s );
+		pieces.push_back( s );
+	}
+
+	size_t walked = 0;
+	while( pieces.size() > 1 )
+	{
+		if( walked > width*height / SPLIT_FRACTION )
+		{
+			rebuild();
+			return;
+		}
+
+		walked += flooding.size();
+		for( int s : flooding )
+		{
+			const uint32_t cell = queues[s][heads[s]++];
+			const int cx = cell % width, cy = cell / width;
+
+			for( int n = 0; n < NUM_SUCCESSORS; n++ )
+			{
+				const int nx = cx + successors[n].dx, ny = cy + successors[n].dy;
+				if( !passable( nx, ny ) ) continue;
+
+				const uint32_t next = ny*width + nx;
+				if( stamps[next] != generation )
+				{
+					stamps[next] = generation;
+					owners[next] = s;
+					queues[s].push_back( next );
+				}
+				else
+				{
+					const int a = findSide( &joined[0], s ), b = findSide( &joined[0], owners[next] );
+					if( a != b ) joined[b] = a;
+				}
+			}
+		}
+
+		flooding.erase( std::remove_if( flooding.begin(), flooding.end(), [&]( int t ) {
+			return heads[t] == queues[t].size();
+		}), flooding.end() );
+
+		// retire pieces that have nowhere left to go
+		for( int s : pieces ) busy[s] = false;
+		for( int t : flooding ) busy[findSide(&joined[0], t)] = true;
+
+		size_t kept = 0;
+		for( int s : pieces )
+		{
+			if( findSide(&joined[0], s) != s ) continue;
+
+			if( busy[s] )
+			{
+				pieces[kept++] = s;
+				continue;
+			}
+
+			const uint32_t label = newLabel();
+			for( int t = 0; t < num_seeds; t++ )
+			{
+				if( findSide(&joined[0], t) != s ) continue;
+
+				for( uint32_t c : queues[t] ) labels[c] = label;
+				cells_relabelled += queues[t].size();
+			}
+		}
+		pieces.resize( kept );
+	}
+}
+
+/*
+ * Component of a cell
+ */
+uint32_t Connectivity::getComponent( int x, int y )
+{
+	if( x < 0 || y < 0 || (size_t)x >= width || (size_t)y >= height ) return NO_COMPONENT;
+
+	const uint32_t label = labels[y*width + x];
+	return label == NO_COMPONENT ? NO_COMPONENT : find( label );
+}
+
+/*
+ * Could any search join start and goal?
+ */
+bool Connectivity::isReachable( int start_x, int start_y, int goal_x, int goal_y )
+{
+	if( goal_x < 0 || goal_y < 0 || (size_t)goal_x >= width || (size_t)goal_y >= height ) return false;
+	if( goal_x == start_x && goal_y == start_y ) return true;
+
+	const uint32_t start = getComponent( start_x, start_y );
+	if( start == NO_COMPONENT ) return false;
+
+	const uint32_t goal = getComponent( goal_x, goal_y );
+	if( goal != NO_COMPONENT ) return goal == start;
+
+	// an impassable goal is reached from any passable cell next to it
+	for( int n = 0; n < NUM_SUCCESSORS; n++ )
+	{
+		if( getComponent( goal_x + successors[n].dx, goal_y + successors[n].dy ) == start )
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,101 @@
+/*
+ * File:	connectivity.h
+ *
+ * Author:	James Letendre
+ *
+ * Connected components of the passable cells, so a path that cannot exist
+ * is turned down without searching for it. Opening a cell joins the
+ * components around it; closing one floods outward from each side only until
+ * the smaller side is known to be cut off, or the sides meet again.
+ */
+#ifndef CONNECTIVITY_H
+#define CONNECTIVITY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <ClanLib/core.h>
+
+class CostGrid;
+
+class Connectivity
+{
+	public:
+		/// Component of impassable cells
+		static const uint32_t NO_COMPONENT = 0;
+
+		/**
+		 * Connectivity(grid)
+		 *
+		 * Label the passable cells of grid, which must then report each cell
+		 * whose cost changes through cellChanged
+		 */
+		Connectivity( const CostGrid *grid );
+
+		/**
+		 * Label every cell again from scratch
+		 */
+		void rebuild();
+
+		/**
+		 * A cell's cost changed, passable or not
+		 */
+		void cellChanged( size_t x, size_t y );
+
+		/**
+		 * The costs of many cells changed at once. The cells closed are
+		 * flooded around together rather than one at a time.
+		 */
+		void cellsChanged( const std::vector<CL_Point> &cells );
+
+		/**
+		 * Component the cell belongs to, NO_COMPONENT if impassable or off the
+		 * map. Two cells share a component if and only if a walk joins them.
+		 */
+		uint32_t getComponent( int x, int y );
+
+		/**
+		 * Could a path from start to goal exist? Same conventions as
+		 * PathSearch::findPath, so the start must be passable but the goal
+		 * need only be next to a passable cell.
+		 */
+		bool isReachable( int start_x, int start_y, int goal_x, int goal_y );
+
+		/**
+		 * Cells visited by flood fills since the last rebuild
+		 */
+		size_t getCellsRelabelled() const { return cells_relabelled; }
+
+	private:
+		bool passable( int x, int y ) const;
+
+		// union find over labels
+		uint32_t find( uint32_t label );
+		uint32_t newLabel();
+
+		void cellOpened( int x, int y );
+		void cellClosed( int x, int y );
+
+		// flood from each seed until the pieces they are in are known, cut
+		// off pieces get labels of their own
+		void split( const uint32_t *seeds, int num_seeds );
+
+		const CostGrid *grid;
+		size_t width, height;
+
+		/// Label of each cell, NO_COMPONENT if impassable. Labels joined since
+		/// are linked through parents.
+		std::vector<uint32_t> labels;
+		std::vector<uint32_t> parents;
+
+		/// Scratch for the floods after a cell closes, a cell belongs to the
+		/// flood in owners if its stamp matches the generation
+		std::vector<uint32_t> stamps;
+		std::vector<uint32_t> owners;
+		uint32_t generation;
+
+		size_t cells_relabelled;
+};
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * File:	cost_grid.h
+ *
+ * Author:	James Letendre
+ *
+ * Dense grid of move costs, kept by the Map and copied out as read only
+ * snapshots for path searches running off the main thread. The grid is
+ * surrounded by a border of impassable cells, so searches can read any
+ * neighbour of a cell on the map without checking bounds.
+ *
+ * Costs are stored in fixed size pages, owned through tables of pages, both
+ * shared between copies. Copying a grid copies the list of tables and an
+ * index of where each page is, a pointer per 4 kB of costs, and a write
+ * to a table or page some other copy still holds copies it first.
+ * Snapshots cost next to nothing next to copying the costs themselves.
+ *
+ * A new grid points every page at one page of the starting cost, so only
+ * pages written since, the border among them, take memory of their own.
+ */
+#ifndef COST_GRID_H
+#define COST_GRID_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// floats in a page of costs, 4 kB, small enough that most rows of a large
+// map span pages clear of the border
+#define COST_PAGE_SHIFT		10
+#define COST_PAGE_SIZE		(1 << COST_PAGE_SHIFT)
+#define COST_PAGE_MASK		(COST_PAGE_SIZE - 1)
+
+// pages in a table, 1 MB of costs
+#define COST_TABLE_SHIFT	8
+#define COST_TABLE_SIZE		(1 << COST_TABLE_SHIFT)
+#define COST_TABLE_MASK		(COST_TABLE_SIZE - 1)
+
+class CostGrid
+{
+	public:
+		CostGrid( size_t w = 0, size_t h = 0, float cost = 0 )
+			: width(w), height(h), stride(w + 2), size((w + 2)*(h + 2)), min_cost(1), max_cost(1), version(0)
+		{
+			const size_t num_pages = (size + COST_PAGE_SIZE - 1) >> COST_PAGE_SHIFT;
+
+			// every page starts out as the same one, copied on first write
+			std::shared_ptr<page_t> fill = std::make_shared<page_t>();
+			std::fill( fill->costs, fill->costs + COST_PAGE_SIZE, cost );
+
+			std::shared_ptr<table_t> fill_table = std::make_shared<table_t>();
+			std::fill( fill_table->pages, fill_table->pages + COST_TABLE_SIZE, fill );
+
+			tables.assign( (num_pages + COST_TABLE_SIZE - 1) >> COST_TABLE_SHIFT, fill_table );
+			page_data.assign( num_pages, fill->costs );
+
+			// impassable border
+			for( size_t x = 0; x < stride; x++ )
+			{
+				write( x, -1 );
+				write( size - stride + x, -1 );
+			}
+			for( size_t y = 0; y < height; y++ )
+			{
+				set( -1, y, -1 );
+				set( width, y, -1 );
+			}
+		}
+
+		size_t getWidth() const { return width; }
+		size_t getHeight() const { return height; }
+
+		/**
+		 * Move cost of the cell, negative if impassable. Cells one past the
+		 * edge of the map read as impassable, no other bounds checking.
+		 */
+		float get( int x, int y ) const { return at( index(x, y) ); }
+		void set( int x, int y, float cost ) { write( index(x, y), cost ); }
+
+		/**
+		 * Give every table and page storage of its own. Afterwards threads
+		 * may set cells on different pages at once, as long as no copy of
+		 * the grid is taken meanwhile.
+		 */
+		void detach()
+		{
+			for( size_t i = 0; i < page_data.size(); i++ )
+			{
+				std::shared_ptr<table_t> &table = tables[i >> COST_TABLE_SHIFT];
+				unshare( table );
+
+				std::shared_ptr<page_t> &page = table->pages[i & COST_TABLE_MASK];
+				if( unshare( page ) )
+					page_data[i] = page->costs;
+			}
+		}
+
+		/**
+		 * Take the costs from getNumPages() pages of COST_PAGE_SIZE floats
+		 * laid out as getPage() hands them out, used in place. They are
+		 * copied on first write, and owner is held until no copy of the
+		 * grid uses them.
+		 */
+		void usePages( float *data, const std::shared_ptr<void> &owner )
+		{
+			for( size_t i = 0; i < page_data.size(); i++ )
+			{
+				std::shared_ptr<table_t> &table = tables[i >> COST_TABLE_SHIFT];
+				unshare( table );
+
+				page_data[i] = data + (i << COST_PAGE_SHIFT);
+				table->pages[i & COST_TABLE_MASK] = std::shared_ptr<page_t>( owner, (page_t*)page_data[i] );
+			}
+		}
+
+		/**
+		 * Costs of one page, COST_PAGE_SIZE of them from raw index
+		 * i*COST_PAGE_SIZE. The last page is padded out.
+		 */
+		const float* getPage( size_t i ) const { return page_data[i]; }
+		size_t getNumPages() const { return page_data.size(); }
+
+		/**
+		 * Cost at a raw index, border included. Cell (x, y) is at
+		 * index(x, y), and a row is getStride() entries long. Reads the
+		 * page's address and then the cost; page_data is a pointer per 4 kB
+		 * so it stays in cache alongside the pages being searched.
+		 */
+		float at( size_t i ) const { return page_data[i >> COST_PAGE_SHIFT][i & COST_PAGE_MASK]; }
+		size_t getStride() const { return stride; }
+		size_t getSize() const { return size; }
+
+		size_t index( int x, int y ) const { return (y + 1)*stride + x + 1; }
+
+		/**
+		 * Lowest cost of any passable cell, a lower bound on each step
+		 */
+		double getMinCost() const { return min_cost; }
+		void setMinCost( double cost ) { min_cost = cost; }
+
+		/**
+		 * Highest cost of any passable cell, an upper bound on each step
+		 */
+		double getMaxCost() const { return max_cost; }
+		void setMaxCost( double cost ) { max_cost = cost; }
+
+		/**
+		 * Bumped by the map each time a cost changes
+		 */
+		uint64_t getVersion() const { return version; }
+		void setVersion( uint64_t v ) { version = v; }
+
+	private:
+		typedef struct
+		{
+			float costs[COST_PAGE_SIZE];
+		} page_t;
+
+		typedef struct
+		{
+			std::shared_ptr<page_t> pages[COST_TABLE_SIZE];
+		} table_t;
+
+		/**
+		 * Write one cost, copying its table and page first if another grid
+		 * shares them
+		 */
+		void write( size_t i, float cost )
+		{
+			std::shared_ptr<table_t> &table = tables[i >> (COST_PAGE_SHIFT + COST_TABLE_SHIFT)];
+			unshare( table );
+
+			std::shared_ptr<page_t> &page = table->pages[(i >> COST_PAGE_SHIFT) & COST_TABLE_MASK];
+			if( unshare( page ) )
+				page_data[i >> COST_PAGE_SHIFT] = page->costs;
+
+			page->costs[i & COST_PAGE_MASK] = cost;
+		}
+
+		/**
+		 * Make ptr the only owner of what it points to, true if it had to
+		 * be copied. Only the thread writing the grid takes new references
+		 * to its tables and pages, so one seen unshared stays unshared; the
+		 * fence orders our writes after the reads of whoever let go of it
+		 * last.
+		 */
+		template<typename T>
+		static bool unshare( std::shared_ptr<T> &ptr )
+		{
+			if( ptr.use_count() > 1 )
+			{
+				ptr = std::make_shared<T>( *ptr );
+				return true;
+			}
+
+			std::atomic_thread_fence( std::memory_order_acquire );
+			return false;
+		}
+
+		size_t width, height;
+		size_t stride, size;
+
+		/// Row major move costs, with a border a cell wide all round, split
+		/// into pages
+		std::vector< std::shared_ptr<table_t> > tables;
+
+		/// Costs of each page, for reading without going through the tables
+		std::vector<float*> page_data;
+
+		double min_cost, max_cost;
+		uint64_t version;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * File:	dirty_set.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Set of cells waiting on work
+ */
+
+#include "map/dirty_set.h"
+
+const uint32_t DirtySet::END;
+
+DirtySet::DirtySet( size_t w, size_t h )
+	: width(w), height(h)
+{
+	clear();
+}
+
+/*
+ * Append a cell to the end of the list
+ */
+bool DirtySet::insert( size_t x, size_t y )
+{
+	if( x >= width || y >= height ) return false;
+
+	const uint32_t cell = y*width + x;
+	if( index.count( cell ) ) return false;
+
+	uint32_t node;
+	if( !free_nodes.empty() )
+	{
+		node = free_nodes.back();
+		free_nodes.pop_back();
+	}
+	else
+	{
+		node = nodes.size();
+		nodes.push_back( node_t() );
+	}
+
+	const uint32_t last = nodes[END].prev;
+
+	nodes[node].cell = cell;
+	nodes[node].prev = last;
+	nodes[node].next = END;
+	nodes[last].next = node;
+	nodes[END].prev = node;
+
+	index[cell] = node;
+	return true;
+}
+
+/*
+ * Unlink a cell from wherever it is in the list
+ */
+bool DirtySet::erase( size_t x, size_t y )
+{
+	if( x >= width || y >= height ) return false;
+
+	auto found = index.find( y*width + x );
+	if( found == index.end() ) return false;
+
+	const uint32_t node = found->second;
+	index.erase( found );
+
+	nodes[nodes[node].prev].next = nodes[node].next;
+	nodes[nodes[node].next].prev = nodes[node].prev;
+	free_nodes.push_back( node );
+
+	return true;
+}
+
+bool DirtySet::contains( size_t x, size_t y ) const
+{
+	return x < width && y < height && index.count( y*width + x );
+}
+
+void DirtySet::clear()
+{
+	nodes.assign( 1, node_t() );
+	nodes[END].prev = nodes[END].next = END;
+	free_nodes.clear();
+	index.clear();
+}
@@ -0,0 +1,92 @@
+/*
+ * File:	dirty_set.h
+ *
+ * Author:	James Letendre
+ *
+ * Set of cells waiting on work, kept in the order they were added. Adding,
+ * removing and looking up a cell are all constant time, and adding a cell
+ * that is already there does nothing.
+ */
+#ifndef DIRTY_SET_H
+#define DIRTY_SET_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unordered_map>
+#include <vector>
+
+#include <ClanLib/core.h>
+
+class DirtySet
+{
+	private:
+		/// Link in the list of cells, or in the list of free nodes
+		typedef struct
+		{
+			uint32_t cell;
+			uint32_t prev, next;
+		} node_t;
+
+	public:
+		/// Walks the cells oldest first
+		class iterator
+		{
+			public:
+				iterator( const DirtySet *set, uint32_t node ) : set(set), node(node) {}
+
+				CL_Point operator*() const { return set->pointOf( set->nodes[node].cell ); }
+				iterator& operator++() { node = set->nodes[node].next; return *this; }
+
+				bool operator==( const iterator &o ) const { return node == o.node; }
+				bool operator!=( const iterator &o ) const { return node != o.node; }
+
+			private:
+				const DirtySet *set;
+				uint32_t node;
+		};
+
+		/**
+		 * DirtySet(w, h)
+		 *
+		 * Empty set of cells on a w by h map
+		 */
+		DirtySet( size_t w, size_t h );
+
+		/**
+		 * Add a cell, false if it was already there
+		 */
+		bool insert( size_t x, size_t y );
+
+		/**
+		 * Remove a cell, false if it wasn't there
+		 */
+		bool erase( size_t x, size_t y );
+
+		bool contains( size_t x, size_t y ) const;
+
+		void clear();
+
+		size_t size() const { return index.size(); }
+		bool empty() const { return index.empty(); }
+
+		iterator begin() const { return iterator( this, nodes[END].next ); }
+		iterator end() const { return iterator( this, END ); }
+
+	private:
+		/// Node that starts and ends the list
+		static const uint32_t END = 0;
+
+		CL_Point pointOf( uint32_t cell ) const { return CL_Point( cell % width, cell / width ); }
+
+		size_t width, height;
+
+		/// Node 0 links the ends of the list, unused nodes are kept on
+		/// free_nodes
+		std::vector<node_t> nodes;
+		std::vector<uint32_t> free_nodes;
+
+		/// Node holding each cell in the set
+		std::unordered_map<uint32_t, uint32_t> index;
+};
+
+#endif
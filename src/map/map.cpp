@@ -9,22 +9,41 @@
 #include "map/map.h"
 #include "map/tileset.h"
 #include "entity/mover.h"
+#include "path/path_search.h"
+#include "path/path_service.h"
+#include "path/flow_field.h"
+#include "map/connectivity.h"
+#include "map/spatial_index.h"
+#include "job/job_board.h"
 
 #include <algorithm>
 
+// path worker threads used unless told otherwise
+#define DEFAULT_PATH_THREADS	2
+
+// cost changes remembered for searches catching up
+#define MAX_CHANGE_LOG	4096
+
+Map::chunk_t Map::empty_chunk;
+
 /*
  * Map(w, h)
  *
  * Create a new map with width, w, and height, h.
  */
 Map::Map(size_t w, size_t h) 
-	: width(w), height(h)
+	: chunks_allocated(0), file_data(NULL), file_size(0), dirty_cells(w, h), width(w), height(h), cost_grid(w, h, Cell().getMoveCost()), first_change(1), path_search(NULL),
+	path_service(NULL), path_threads(DEFAULT_PATH_THREADS), flow_fields(NULL),
+	connectivity(NULL), entity_index(NULL), job_board(NULL), movers(NULL)
 {
-	map = new Cell*[width];
-	for( size_t i = 0; i < width; i++ )
-	{
-		map[i] = new Cell[height];
-	}
+	chunks_wide = (width + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+	chunks_high = (height + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+	chunks.assign( chunks_wide*chunks_high, &empty_chunk );
+
+	surface_counts.assign( Cell::num_cell_types, 0 );
+	surface_counts[ Cell().getSurfaceId() ] = width*height;
+
+	updateCostBounds();
 }
 
 /*
@@ -34,11 +53,20 @@ Map::Map(size_t w, size_t h)
  */
 Map::~Map()
 {
-	for( size_t i = 0; i < width; i++ )
+	for( chunk_t *chunk : chunks )
 	{
-		delete[] map[i];
+		if( chunk != &empty_chunk && !inFile(chunk) )
+			delete chunk;
 	}
-	delete[] map;
+
+	// workers may still be reading snapshots, stop them first
+	delete path_service;
+	delete path_search;
+	delete flow_fields;
+	delete connectivity;
+	delete entity_index;
+	delete job_board;
+	delete movers;
 }
 
 /*
@@ -46,86 +74,104 @@ Map::~Map()
  */
 void Map::update()
 {
-	for( auto iter = modified_list.begin(); iter != modified_list.end(); iter++ )
-	{
-		if( getCell(iter->x, iter->y)->isBuilt() )
-		{
-			iter = modified_list.erase(iter) - 1;
-		}
-	}
+	if( job_board )
+		job_board->update();
 }
 
 /*
- * draw(gc)
+ * find_neighbors
  *
- * Draw the map using the specified GraphicContext
+ * Find the types of the cells neighboring this cell
+ * Used for cells that have different appearances based on neighbors
  */
-void Map::draw( CL_GraphicContext &gc, double origin_x, double origin_y, double cell_width, double cell_height, double window_width, double window_height )
+int Map::find_neighbors( int type, int x, int y )
 {
-	gc.push_modelview();
-
-	// draw each cell
-	for( size_t i = 0; i < width; i++ )
-	{
-		double x_pos = i*cell_width + origin_x;
+	int index = -type;
 
-		if( x_pos < -cell_width ) continue;		// not in window yet, not visible
-		if( x_pos > window_width ) break;		// beyond end of window, not visible
+	// check N, S, E, W
+	if( y > 0 					&& cellAt(x, y-1).getBuildingType() == type ) index += MULTI_N;
+	if( (size_t)y + 1 < height	&& cellAt(x, y+1).getBuildingType() == type ) index += MULTI_S;
+	if( (size_t)x + 1 < width	&& cellAt(x+1, y).getBuildingType() == type ) index += MULTI_E;
+	if( x > 0					&& cellAt(x-1, y).getBuildingType() == type ) index += MULTI_W;
 
-		for( size_t j = 0; j < height; j++ )
-		{
-			double y_pos = j*cell_height + origin_y;
+	return index;
+}
 
-			if( y_pos < -cell_height ) continue;	// not in window yet, not visible
-			if( y_pos > window_height ) break;		// beyond end of window, not visible
+/*
+ * Cache the tileset frames a building change can affect, so drawing
+ * never has to look at the neighbours
+ */
+void Map::updateFrames( int x, int y )
+{
+	static const int around[5][2] = { {0,0}, {0,-1}, {0,1}, {1,0}, {-1,0} };
 
-			// determine the tileset type
-			int cell_type = map[i][j].getBuildingType();
+	for( int i = 0; i < 5; i++ )
+		updateFrame( x + around[i][0], y + around[i][1] );
+}
 
-			if( cell_type < 0 )
-				cell_type = find_neighbors(cell_type, i, j);
+void Map::updateFrame( int x, int y )
+{
+	if( x < 0 || y < 0 || (size_t)x >= width || (size_t)y >= height ) return;
 
-			if( cell_type >= 0 )
-			{
-				gc.set_translate((float)x_pos, (float)y_pos, 0);
-				map[i][j].draw(gc, cell_width, cell_height, cell_type);
-			}
-		}
-	}
+	int frame = cellAt(x, y).getBuildingType();
+	if( frame < 0 )
+		frame = find_neighbors(frame, x, y);
 
-	gc.pop_modelview();
+	// untouched chunks keep sharing the default while nothing changes
+	if( frame != frameAt(x, y) )
+		editChunk(x, y)->frames[localIndex(x, y)] = frame;
 }
 
-/*
- * find_neighbors
- *
- * Find the types of the cells neighboring this cell
- * Used for cells that have different appearances based on neighbors
+/**
+ * Copy of the specified cell
  */
-int Map::find_neighbors( int type, int x, int y )
+Cell Map::getCell( size_t x, size_t y )
 {
-	int index = -type;
+	if( x < width && y < height )
+		return cellAt(x, y);
+	else
+		return Cell();
+}
 
-	// check N, S, E, W
-	if( y > 0 				&& map[x][y-1].getBuildingType() == type ) index += MULTI_N;
-	if( (size_t)y < height 	&& map[x][y+1].getBuildingType() == type ) index += MULTI_S;
-	if( (size_t)x < width	&& map[x+1][y].getBuildingType() == type ) index += MULTI_E;
-	if( x > 0				&& map[x-1][y].getBuildingType() == type ) index += MULTI_W;
+double Map::getMoveCost( size_t x, size_t y )
+{
+	if( x < width && y < height )
+		return cost_grid.get(x, y);
+	else
+		return -1;
+}
 
-	return index;
+bool Map::isBuilt( size_t x, size_t y )
+{
+	return x >= width || y >= height || cellAt(x, y).isBuilt();
 }
 
-/**
- * Get the specified cell out of the map
+/*
+ * Cells of one chunk
  */
-const Cell* Map::getCell( size_t x, size_t y )
+const Cell* Map::getChunk( size_t chunk_x, size_t chunk_y )
 {
-	if( x < width && y < height )
-		return &map[x][y];
+	if( chunk_x < chunks_wide && chunk_y < chunks_high )
+		return chunks[chunk_y*chunks_wide + chunk_x]->cells;
 	else
 		return NULL;
 }
 
+/*
+ * Writable chunk, copying it out of the shared default first
+ */
+Map::chunk_t* Map::editChunk( size_t x, size_t y )
+{
+	chunk_t *&chunk = chunks[chunkIndex(x, y)];
+	if( chunk == &empty_chunk )
+	{
+		chunk = new chunk_t( empty_chunk );
+		chunks_allocated++;
+	}
+
+	return chunk;
+}
+
 /**
  * Sets the base type of this cell
  */
@@ -133,9 +179,12 @@ void Map::setCellBase( size_t x, size_t y, int id )
 {
 	if( x < width && y < height )
 	{
-		map[x][y].setBaseId(id);
-
-		modified_list.push_back( CL_Point(x,y) );
+		Cell &cell = editCell(x, y);
+		int old_surface = cell.getSurfaceId();
+		cell.setBaseId(id);
+		cellChanged(x, y, old_surface);
+		updateCostBounds();
+		trackWork(x, y);
 	}
 }
 
@@ -146,9 +195,30 @@ void Map::setCellBuilding( size_t x, size_t y, int id )
 {
 	if( x < width && y < height )
 	{
-		map[x][y].setBuildingId(id);
+		Cell &cell = editCell(x, y);
+		int old_surface = cell.getSurfaceId();
+		cell.setBuildingId(id);
+		cellChanged(x, y, old_surface);
+		updateCostBounds();
+		updateFrames(x, y);
+		trackWork(x, y);
+	}
+}
 
-		modified_list.push_back( CL_Point(x,y) );
+/*
+ * Keep a cell in dirty_cells for as long as it has building left to do
+ */
+void Map::trackWork( size_t x, size_t y )
+{
+	if( cellAt(x, y).isBuilt() )
+	{
+		if( dirty_cells.erase( x, y ) && job_board )
+			job_board->jobEnded( x, y, false );
+	}
+	else
+	{
+		if( dirty_cells.insert( x, y ) && job_board )
+			job_board->jobOpened( x, y );
 	}
 }
 
@@ -159,36 +229,212 @@ void Map::buildCell( size_t x, size_t y, double speed )
 {
 	if( x < width && y < height )
 	{
-		map[x][y].build( speed );
+		if( cellAt(x, y).isBuilt() ) return;
+
+		Cell &cell = editCell(x, y);
+		int old_surface = cell.getSurfaceId();
+		cell.build( speed );
 
-		if( map[x][y].isBuilt() )
+		if( cell.isBuilt() )
 		{
-			CL_Point p(x,y);
-			modified_list.erase( std::find(modified_list.begin(), modified_list.end(), p ));
+			cellChanged(x, y, old_surface);
+			updateCostBounds();
+			if( dirty_cells.erase( x, y ) && job_board )
+				job_board->jobEnded( x, y, true );
 		}
 	}
 }
 
 /*
- * command robots to perform changes to cells
+ * Search context shared by path queries on this map
+ */
+PathSearch& Map::getPathSearch()
+{
+	if( !path_search )
+		path_search = new PathSearch(&cost_grid);
+
+	return *path_search;
+}
+
+/*
+ * Worker threads answering path requests on this map
+ */
+PathService& Map::getPathService()
+{
+	if( !path_service )
+		path_service = new PathService(this, path_threads);
+
+	return *path_service;
+}
+
+void Map::setPathThreads( int threads )
+{
+	path_threads = std::max( 0, threads );
+
+	delete path_service;
+	path_service = NULL;
+}
+
+/*
+ * Cells changed to bring the costs to version
+ */
+bool Map::getChange( uint64_t version, CL_Rect &rect )
+{
+	if( version < first_change || version - first_change >= change_log.size() ) return false;
+
+	rect = change_log[version - first_change];
+	return true;
+}
+
+/*
+ * Read only copy of the move costs
+ */
+std::shared_ptr<const CostGrid> Map::getCostSnapshot()
+{
+	if( !cost_snapshot || cost_snapshot->getVersion() != cost_grid.getVersion() )
+		cost_snapshot = std::make_shared<const CostGrid>( cost_grid );
+
+	return cost_snapshot;
+}
+
+/*
+ * Distance fields towards destinations shared by many movers
+ */
+FlowFieldCache& Map::getFlowFields()
+{
+	if( !flow_fields )
+		flow_fields = new FlowFieldCache(this);
+
+	return *flow_fields;
+}
+
+/*
+ * Connected components of the passable cells
+ */
+Connectivity& Map::getConnectivity()
+{
+	if( !connectivity )
+		connectivity = new Connectivity(&cost_grid);
+
+	return *connectivity;
+}
+
+bool Map::isReachable( int start_x, int start_y, int goal_x, int goal_y )
+{
+	return getConnectivity().isReachable( start_x, start_y, goal_x, goal_y );
+}
+
+JobBoard& Map::getJobBoard()
+{
+	if( !job_board )
+		job_board = new JobBoard(this);
+
+	return *job_board;
+}
+
+MoverStore& Map::getMovers()
+{
+	if( !movers )
+		movers = new MoverStore(this);
+
+	return *movers;
+}
+
+SpatialIndex& Map::getEntityIndex()
+{
+	if( !entity_index )
+		entity_index = new SpatialIndex(width, height);
+
+	return *entity_index;
+}
+
+/*
+ * Lowest move cost of any passable cell on the map
  */
-void Map::processChanges( std::vector<Mover*> &robots )
+double Map::getMinMoveCost()
 {
-	if( !hasChanges() ) return;
+	double min_cost = -1;
+	for( size_t i = 0; i < Cell::num_cell_types; i++ )
+	{
+		double c = Cell::Types[i].move_cost;
+		if( surface_counts[i] > 0 && c > 0 && ( min_cost < 0 || c < min_cost ) )
+			min_cost = c;
+	}
 
-	auto iter = modified_list.begin();
+	return min_cost > 0 ? min_cost : 1;
+}
 
-	for( Mover *m : robots )
+/*
+ * Highest move cost of any passable cell on the map
+ */
+double Map::getMaxMoveCost()
+{
+	double max_cost = -1;
+	for( size_t i = 0; i < Cell::num_cell_types; i++ )
 	{
-		if( m->isIdle() )
-		{
-			m->setDestination( iter->x, iter->y );
-			iter++;
+		double c = Cell::Types[i].move_cost;
+		if( surface_counts[i] > 0 && c > max_cost )
+			max_cost = c;
+	}
 
-			if( iter == modified_list.end() ) 
-				return;
-		}
+	return max_cost > 0 ? max_cost : 1;
+}
+
+/*
+ * Keep derived path data in step with a cell whose surface may have changed
+ */
+void Map::cellChanged( size_t x, size_t y, int old_surface )
+{
+	if( !surfaceChanged(x, y, old_surface) ) return;
+
+	costsChanged( CL_Rect(x, y, x + 1, y + 1) );
 
+	if( connectivity )
+		connectivity->cellChanged(x, y);
+}
+
+/*
+ * Count and cost of the cell's new surface
+ */
+bool Map::surfaceChanged( size_t x, size_t y, int old_surface )
+{
+	const Cell &cell = cellAt(x, y);
+	int surface = cell.getSurfaceId();
+	if( surface == old_surface ) return false;
+
+	surface_counts[old_surface]--;
+	surface_counts[surface]++;
+
+	cost_grid.set( x, y, cell.getMoveCost() );
+	return true;
+}
+
+/*
+ * One new cost version for everything changed inside rect
+ */
+void Map::costsChanged( const CL_Rect &rect )
+{
+	cost_grid.setVersion( cost_grid.getVersion() + 1 );
+
+	change_log.push_back( rect );
+	if( change_log.size() > MAX_CHANGE_LOG )
+	{
+		change_log.pop_front();
+		first_change++;
 	}
+
+	if( path_service )
+		path_service->regionChanged(rect, cost_grid.getVersion());
+
+	if( flow_fields )
+		flow_fields->regionChanged(rect);
 }
 
+/*
+ * Cheapest and dearest passable surface still on the map
+ */
+void Map::updateCostBounds()
+{
+	cost_grid.setMinCost( getMinMoveCost() );
+	cost_grid.setMaxCost( getMaxMoveCost() );
+}
@@ -9,10 +9,26 @@
 #define MAP_H
 
 #include <stdlib.h>
+#include <deque>
+#include <memory>
 
 #include "cell.h"
-#include <ClanLib/display.h>
+#include "map/cost_grid.h"
+#include "map/dirty_set.h"
+#include <ClanLib/core.h>
+// cells are stored in square chunks of CHUNK_SIZE cells a side
+#define CHUNK_SHIFT	5
+#define CHUNK_SIZE	(1 << CHUNK_SHIFT)
+#define CHUNK_MASK	(CHUNK_SIZE - 1)
+
 class Mover;
+class PathSearch;
+class PathService;
+class FlowFieldCache;
+class Connectivity;
+class SpatialIndex;
+class JobBoard;
+class MoverStore;
 
 class Map 
 {
@@ -32,16 +48,33 @@ class Map
 		~Map();
 
 		/**
-		 * Process changes to map
+		 * Open a map written by save(). The file is mapped into memory and
+		 * its chunks and move costs are used in place, each read from disk
+		 * the first time it is touched. Only chunks with cells left to build
+		 * are read up front, to queue the work. Files written before move
+		 * costs were saved are read in full. Returns NULL if the file can't
+		 * be used.
 		 */
-		void update();
+		static Map* load( const char *filename );
 
 		/**
-		 * draw(gc)
-		 *
-		 * Draw the map using the specified GraphicContext
+		 * Write the map to filename a chunk at a time, untouched chunks take
+		 * no space. Returns false on failure, leaving any existing file alone.
+		 */
+		bool save( const char *filename );
+
+		/**
+		 * New w by h map of noise generated terrain, lakes of water on grass,
+		 * lava and empty ground. Chunks are filled by threads workers, one
+		 * per core if 0; the map depends only on the seed, never on how many
+		 * threads made it.
+		 */
+		static Map* generate( size_t w, size_t h, uint32_t seed, int threads = 0 );
+
+		/**
+		 * Process changes to map, handing out jobs to idle robots
 		 */
-		void draw( CL_GraphicContext &gc, double origin_x, double origin_y, double cell_width, double cell_height, double window_width, double window_height );
+		void update();
 
 		/**
 		 * getWidth()
@@ -53,9 +86,40 @@ class Map
 		size_t getHeight() { return height; }
 
 		/**
-		 * Get the specified cell out of the map
+		 * Copy of the specified cell, a default cell off the map
+		 */
+		Cell getCell( size_t x, size_t y );
+
+		/**
+		 * Move cost of the cell, negative if impassable or off the map
+		 */
+		double getMoveCost( size_t x, size_t y );
+
+		/**
+		 * Is the cell's building finished, true if it has none
+		 */
+		bool isBuilt( size_t x, size_t y );
+
+		/**
+		 * Cells of the chunk at (chunk_x, chunk_y), CHUNK_SIZE*CHUNK_SIZE of
+		 * them row major. Cells past the edge of the map are unused.
+		 * Untouched chunks all share one block of default cells.
+		 */
+		const Cell* getChunk( size_t chunk_x, size_t chunk_y );
+
+		size_t getChunksWide() { return chunks_wide; }
+		size_t getChunksHigh() { return chunks_high; }
+
+		/**
+		 * Tileset frame for the cell's building, with multi tile buildings
+		 * already matched to their neighbours. 0 without a building.
 		 */
-		const Cell* getCell( size_t x, size_t y );
+		int getTileFrame( size_t x, size_t y ) { return x < width && y < height ? frameAt(x, y) : 0; }
+
+		/**
+		 * Number of chunks with storage of their own
+		 */
+		size_t getChunksAllocated() { return chunks_allocated; }
 
 		/**
 		 * Sets the base type of this cell
@@ -67,6 +131,28 @@ class Map
 		 */
 		void setCellBuilding( size_t x, size_t y, int id );
 
+		/// Which part of the cells a bulk edit sets
+		typedef enum { EDIT_BASE, EDIT_BUILDING } edit_layer_t;
+
+		/**
+		 * Set the base or building of every cell in the rectangle from
+		 * (x0, y0) to (x1, y1), corners included and clipped to the map.
+		 * Cells already set to id are left alone.
+		 */
+		void editRect( int x0, int y0, int x1, int y1, edit_layer_t layer, int id );
+
+		/**
+		 * Set the cells on the line from (x0, y0) to (x1, y1), so a brush
+		 * moved between two samples leaves no gaps
+		 */
+		void editLine( int x0, int y0, int x1, int y1, edit_layer_t layer, int id );
+
+		/**
+		 * Set the region around (x, y) whose cells share its base or
+		 * building, joined across edges. Returns the number of cells set.
+		 */
+		size_t editFill( int x, int y, edit_layer_t layer, int id );
+
 		/**
 		 * Build the specified cell
 		 */
@@ -75,12 +161,95 @@ class Map
 		/**
 		 * Check if there are cells that need attention in the map
 		 */
-		bool hasChanges() { return modified_list.size() > 0; }
+		bool hasChanges() { return !dirty_cells.empty(); }
+
+		/**
+		 * Number of cells still waiting to be built
+		 */
+		size_t getPendingWork() { return dirty_cells.size(); }
+
+		/**
+		 * Cells still waiting to be built, oldest first
+		 */
+		const DirtySet& getPendingCells() { return dirty_cells; }
+
+
+		/**
+		 * Lowest move cost of any passable cell on the map, a lower bound on
+		 * the cost of each step
+		 */
+		double getMinMoveCost();
+
+		/**
+		 * Highest move cost of any passable cell on the map
+		 */
+		double getMaxMoveCost();
+
+		/**
+		 * Move cost of every cell, kept in step with the cells
+		 */
+		const CostGrid& getCostGrid() { return cost_grid; }
+
+		/**
+		 * Cells whose move costs changed to bring the cost grid to version,
+		 * as the rectangle bounding them. An edit of many cells is a single
+		 * version. Returns false once the change is too old to be kept.
+		 */
+		bool getChange( uint64_t version, CL_Rect &rect );
+
+		/**
+		 * Read only copy of the move costs for searches off the main thread,
+		 * a new copy is only made after the costs change. Copies share the
+		 * pages of costs that haven't changed since.
+		 */
+		std::shared_ptr<const CostGrid> getCostSnapshot();
+
+		/**
+		 * Search context shared by path queries on this map
+		 */
+		PathSearch& getPathSearch();
+
+		/**
+		 * Worker threads answering path requests on this map
+		 */
+		PathService& getPathService();
+
+		/**
+		 * Number of path worker threads, 0 answers requests immediately.
+		 * Outstanding requests are dropped, so set it before anything moves.
+		 */
+		void setPathThreads( int threads );
+
+		/**
+		 * Distance fields towards destinations shared by many movers
+		 */
+		FlowFieldCache& getFlowFields();
 
 		/**
-		 * Command idle robots from the list to move to cells needing work
+		 * Connected components of the passable cells
 		 */
-		void processChanges( std::vector<Mover*> &robots );
+		Connectivity& getConnectivity();
+
+		/**
+		 * False if no path from start to goal can exist, so there is no need
+		 * to search for one
+		 */
+		bool isReachable( int start_x, int start_y, int goal_x, int goal_y );
+
+		/**
+		 * Entities on the map by position, each entity keeps itself up to date
+		 */
+		SpatialIndex& getEntityIndex();
+
+		/**
+		 * Jobs for the cells waiting to be built, which idle robots take
+		 */
+		JobBoard& getJobBoard();
+
+		/**
+		 * State of every mover on the map, each mover adds and removes itself
+		 */
+		MoverStore& getMovers();
 
 		/*
 		 * TODO: More functionality
@@ -89,14 +258,127 @@ class Map
 	private:
 		int find_neighbors( int type, int x, int y );
 
-		/// The underlying map
-		Cell **map;
+		/// Work out the tileset frame of the cell and the four next to it
+		void updateFrames( int x, int y );
+
+		/// Work out the tileset frame of one cell
+		void updateFrame( int x, int y );
+
+		/// Add the cell to dirty_cells if it needs building, drop it if not
+		void trackWork( size_t x, size_t y );
 
-		/// The list of modified cells
-		std::vector<CL_Point> modified_list;
+		/// Update data derived from the cell after its surface may have
+		/// changed. The caller always follows up with updateCostBounds.
+		void cellChanged( size_t x, size_t y, int old_surface );
+
+		/// Count the cell's new surface and set its cost, false if its
+		/// surface didn't change
+		bool surfaceChanged( size_t x, size_t y, int old_surface );
+
+		/// Bring the cost version, change log, path service and flow fields
+		/// up to date with costs changed inside rect, all in one go
+		void costsChanged( const CL_Rect &rect );
+
+		/// Bring the cost grid's lowest and highest costs up to date
+		void updateCostBounds();
+
+		/// Set one layer of a list of cells on the map, updating what is
+		/// derived from them once for the lot
+		void editCells( const std::vector<CL_Point> &cells, edit_layer_t layer, int id );
+
+		/// Square block of cells and their building's tileset frames, row
+		/// major
+		typedef struct
+		{
+			Cell cells[CHUNK_SIZE*CHUNK_SIZE];
+			int8_t frames[CHUNK_SIZE*CHUNK_SIZE];
+		} chunk_t;
+
+		static size_t localIndex( size_t x, size_t y ) { return ((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK); }
+		size_t chunkIndex( size_t x, size_t y ) const { return (y >> CHUNK_SHIFT)*chunks_wide + (x >> CHUNK_SHIFT); }
+
+		/// Cell to read, no bounds checking
+		const Cell& cellAt( size_t x, size_t y ) const { return chunks[chunkIndex(x, y)]->cells[localIndex(x, y)]; }
+		int frameAt( size_t x, size_t y ) const { return chunks[chunkIndex(x, y)]->frames[localIndex(x, y)]; }
+
+		/// Chunk holding a cell about to change, giving it storage of its own
+		/// first. Chunks in a loaded file are changed in place, the mapping
+		/// is private so the file itself is never written.
+		chunk_t* editChunk( size_t x, size_t y );
+
+		/// Bring the counts and costs in line with a chunk read from a file
+		/// that doesn't store them
+		void chunkLoaded( size_t chunk );
+
+		/// Queue the cells of a chunk read from a file that are left to build
+		void chunkWork( size_t chunk );
+
+		/// Fill one chunk with terrain, counting the surfaces made into counts
+		void generateChunk( size_t chunk, uint32_t seed, std::vector<size_t> &counts );
+
+		/// Tileset frames of the multi tile buildings in a generated chunk
+		void generateFrames( size_t chunk );
+
+		bool inFile( const chunk_t *chunk ) const
+		{
+			return (const char*)chunk >= file_data && (const char*)chunk < file_data + file_size;
+		}
+		Cell& editCell( size_t x, size_t y ) { return editChunk(x, y)->cells[localIndex(x, y)]; }
+
+		/// The underlying map, untouched chunks point at empty_chunk
+		std::vector<chunk_t*> chunks;
+		size_t chunks_wide, chunks_high;
+		size_t chunks_allocated;
+
+		/// Default cells shared by every untouched chunk, never written
+		static chunk_t empty_chunk;
+
+		/// Map file the chunks may point into, NULL if none
+		char *file_data;
+		size_t file_size;
+
+		/// Unmaps the file once neither the map nor a snapshot of its costs
+		/// uses it
+		std::shared_ptr<void> file_owner;
+
+		/// Cells changed but not yet built, oldest first
+		DirtySet dirty_cells;
 
 		/// Size of map
 		size_t width, height;
+
+		/// Number of cells of each surface type
+		std::vector<size_t> surface_counts;
+
+		/// Move cost of each cell, and the last copy handed out
+		CostGrid cost_grid;
+		std::shared_ptr<const CostGrid> cost_snapshot;
+
+		/// Recent cost changes, the oldest brought the grid to first_change
+		std::deque<CL_Rect> change_log;
+		uint64_t first_change;
+
+		/// Reusable path search storage, created on first use
+		PathSearch *path_search;
+
+		/// Path request workers, created on first use
+		PathService *path_service;
+		int path_threads;
+
+		/// Fields towards job sites, created on first use
+		FlowFieldCache *flow_fields;
+
+		/// Component labels, created on first use
+		Connectivity *connectivity;
+
+		/// Entity positions, created on first use
+		SpatialIndex *entity_index;
+
+		/// Jobs and robots' claims on them, created on first use
+		JobBoard *job_board;
+
+		/// Movers' state, created on first use
+		MoverStore *movers;
 };
 
 #endif
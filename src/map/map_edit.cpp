@@ -0,0 +1,189 @@
+/*
+ * File:	map_edit.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Edits covering many cells at once. The cells are changed first, then what
+ * is derived from them is brought up to date in one pass: one cost version,
+ * with the path service, path cache and flow fields told of the rectangle
+ * bounding the changed cells, cost bounds and tileset frames once for the
+ * whole edit, and connectivity relabelled in one flood, or from scratch when
+ * the edit is large enough that flooding would be slower.
+ */
+
+#include "map/map.h"
+#include "map/connectivity.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <unordered_set>
+
+// edits covering more than 1/RELABEL_FRACTION of the map relabel it whole
+#define RELABEL_FRACTION	16
+
+void Map::editRect( int x0, int y0, int x1, int y1, edit_layer_t layer, int id )
+{
+	if( x1 < x0 ) std::swap( x0, x1 );
+	if( y1 < y0 ) std::swap( y0, y1 );
+
+	x0 = std::max( x0, 0 );
+	y0 = std::max( y0, 0 );
+	x1 = std::min( x1, (int)width - 1 );
+	y1 = std::min( y1, (int)height - 1 );
+
+	std::vector<CL_Point> cells;
+	for( int y = y0; y <= y1; y++ )
+	{
+		for( int x = x0; x <= x1; x++ )
+			cells.push_back( CL_Point(x, y) );
+	}
+
+	editCells( cells, layer, id );
+}
+
+/*
+ * Bresenham's line, cells off the map are skipped
+ */
+void Map::editLine( int x0, int y0, int x1, int y1, edit_layer_t layer, int id )
+{
+	const int dx = abs( x1 - x0 ), dy = -abs( y1 - y0 );
+	const int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+	int error = dx + dy;
+
+	std::vector<CL_Point> cells;
+	for(;;)
+	{
+		if( x0 >= 0 && y0 >= 0 && (size_t)x0 < width && (size_t)y0 < height )
+			cells.push_back( CL_Point(x0, y0) );
+
+		if( x0 == x1 && y0 == y1 ) break;
+
+		const int e2 = 2*error;
+		if( e2 >= dy ) { error += dy; x0 += sx; }
+		if( e2 <= dx ) { error += dx; y0 += sy; }
+	}
+
+	editCells( cells, layer, id );
+}
+
+/*
+ * Scanline fill of the cells matching the start, a run of a row at a time
+ */
+size_t Map::editFill( int x, int y, edit_layer_t layer, int id )
+{
+	if( x < 0 || y < 0 || (size_t)x >= width || (size_t)y >= height ) return 0;
+
+	auto layerId = [&]( int cx, int cy ) {
+		const Cell &cell = cellAt(cx, cy);
+		return layer == EDIT_BASE ? cell.getBaseId() : cell.getBuildingId();
+	};
+
+	const int target = layerId( x, y );
+	if( target == id ) return 0;
+
+	// only the cells filled are ever marked, however large the map
+	std::unordered_set<uint32_t> seen;
+	std::vector<CL_Point> cells, stack;
+	stack.push_back( CL_Point(x, y) );
+
+	while( !stack.empty() )
+	{
+		CL_Point p = stack.back();
+		stack.pop_back();
+
+		if( seen.count( p.y*width + p.x ) ) continue;
+
+		// widen to the whole run of matching cells in this row
+		int left = p.x, right = p.x;
+		while( left > 0 && layerId( left - 1, p.y ) == target ) left--;
+		while( (size_t)right + 1 < width && layerId( right + 1, p.y ) == target ) right++;
+
+		for( int cx = left; cx <= right; cx++ )
+		{
+			seen.insert( p.y*width + cx );
+			cells.push_back( CL_Point(cx, p.y) );
+
+			// queue the start of each matching run above and below
+			for( int ny = p.y - 1; ny <= p.y + 1; ny += 2 )
+			{
+				if( ny < 0 || (size_t)ny >= height ) continue;
+				if( layerId( cx, ny ) != target || seen.count( ny*width + cx ) ) continue;
+				if( cx > left && layerId( cx - 1, ny ) == target ) continue;
+
+				stack.push_back( CL_Point(cx, ny) );
+			}
+		}
+	}
+
+	editCells( cells, layer, id );
+	return cells.size();
+}
+
+/*
+ * Change the cells, then update what depends on them
+ */
+void Map::editCells( const std::vector<CL_Point> &cells, edit_layer_t layer, int id )
+{
+	std::vector<size_t> frames;
+
+	// cells whose cost changed, and the rectangle bounding them
+	std::vector<CL_Point> changed;
+	CL_Rect bounds;
+
+	for( const CL_Point &p : cells )
+	{
+		const Cell &old = cellAt(p.x, p.y);
+		if( ( layer == EDIT_BASE ? old.getBaseId() : old.getBuildingId() ) == id ) continue;
+
+		Cell &cell = editCell(p.x, p.y);
+		int old_surface = cell.getSurfaceId();
+
+		if( layer == EDIT_BASE )
+			cell.setBaseId(id);
+		else
+		{
+			cell.setBuildingId(id);
+
+			// the cell and the four whose frames it could change
+			frames.push_back( p.y*width + p.x );
+			if( p.y > 0 ) frames.push_back( (p.y - 1)*width + p.x );
+			if( (size_t)p.y + 1 < height ) frames.push_back( (p.y + 1)*width + p.x );
+			if( p.x > 0 ) frames.push_back( p.y*width + p.x - 1 );
+			if( (size_t)p.x + 1 < width ) frames.push_back( p.y*width + p.x + 1 );
+		}
+
+		if( surfaceChanged(p.x, p.y, old_surface) )
+		{
+			if( changed.empty() )
+				bounds = CL_Rect( p.x, p.y, p.x + 1, p.y + 1 );
+			else
+			{
+				bounds.left = std::min( bounds.left, p.x );
+				bounds.top = std::min( bounds.top, p.y );
+				bounds.right = std::max( bounds.right, p.x + 1 );
+				bounds.bottom = std::max( bounds.bottom, p.y + 1 );
+			}
+			changed.push_back( p );
+		}
+
+		trackWork(p.x, p.y);
+	}
+
+	if( !changed.empty() )
+	{
+		costsChanged( bounds );
+
+		// a big edit is cheaper to relabel in one go than to flood around
+		if( connectivity && changed.size() > width*height / RELABEL_FRACTION )
+			connectivity->rebuild();
+		else if( connectivity )
+			connectivity->cellsChanged( changed );
+	}
+
+	updateCostBounds();
+
+	std::sort( frames.begin(), frames.end() );
+	frames.erase( std::unique( frames.begin(), frames.end() ), frames.end() );
+	for( size_t i : frames )
+		updateFrame( i % width, i / width );
+}
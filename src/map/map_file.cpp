@@ -0,0 +1,322 @@
+/*
+ * File:	map_file.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Saving and loading maps. A map file is laid out so it can be mapped into
+ * memory and used as is:
+ *
+ *   header		fixed size, see file_header_t
+ *   index		one 64 bit file offset per chunk, row major, 0 for a chunk
+ *				of default cells that isn't stored
+ *   counts		one 64 bit count of cells per surface type
+ *   work		one 32 bit count per chunk of cells left to build
+ *   costs		the cost grid's pages, starting on a COST_ALIGN boundary
+ *   chunks		raw chunk_t blocks, each starting on a CHUNK_ALIGN boundary
+ *
+ * Version 1 files stop at the index and chunks, loading them reads every
+ * chunk to work out the rest.
+ *
+ * Everything is in the byte order of the machine that wrote it; the header
+ * records enough of the layout to turn away files that don't match.
+ */
+
+#include "map/map.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#define MAP_FILE_MAGIC		0x50414d52	// "RMAP"
+#define MAP_FILE_VERSION	2
+#define MAP_FILE_ENDIAN		0x01020304
+
+// chunk data offsets are multiples of this
+#define CHUNK_ALIGN	64
+
+// the costs start on a memory page, so each cost page is read on its own
+#define COST_ALIGN	4096
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t endian;
+
+	uint32_t width, height;
+
+	/// Layout of a chunk, CHUNK_SIZE and sizeof(chunk_t)
+	uint32_t chunk_size;
+	uint32_t chunk_bytes;
+
+	uint32_t num_cell_types;
+
+	/// Where the index and the first chunk start
+	uint64_t index_offset;
+	uint64_t data_offset;
+
+	/// Where the surface counts, work counts and costs start, and the
+	/// floats in a cost page. Version 2 on.
+	uint64_t counts_offset;
+	uint64_t work_offset;
+	uint64_t cost_offset;
+	uint32_t cost_page_size;
+	uint32_t reserved;
+} file_header_t;
+
+static uint64_t alignUp( uint64_t offset, uint64_t align = CHUNK_ALIGN )
+{
+	return (offset + align - 1) / align * align;
+}
+
+/*
+ * Open a saved map in place
+ */
+Map* Map::load( const char *filename )
+{
+	int fd = open( filename, O_RDONLY );
+	if( fd < 0 ) return NULL;
+
+	struct stat st;
+	if( fstat( fd, &st ) < 0 || (size_t)st.st_size < sizeof(file_header_t) )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	// private, so changes to the map copy the pages they touch rather than
+	// writing through to the file
+	const size_t size = st.st_size;
+	void *data = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if( data == MAP_FAILED )
+	{
+		fprintf(stderr, "Map: Can't map %s: %s\n", filename, strerror(errno));
+		return NULL;
+	}
+
+	const file_header_t *header = (const file_header_t*)data;
+	const size_t num_chunks = (size_t)((header->width + CHUNK_SIZE - 1) >> CHUNK_SHIFT) *
+		((header->height + CHUNK_SIZE - 1) >> CHUNK_SHIFT);
+
+	if( header->magic != MAP_FILE_MAGIC || header->version < 1 || header->version > MAP_FILE_VERSION ||
+			header->endian != MAP_FILE_ENDIAN || header->chunk_size != CHUNK_SIZE ||
+			header->chunk_bytes != sizeof(chunk_t) || header->num_cell_types != Cell::num_cell_types ||
+			header->index_offset + num_chunks*sizeof(uint64_t) > size )
+	{
+		fprintf(stderr, "Map: %s is not a map this version can read\n", filename);
+		munmap( data, size );
+		return NULL;
+	}
+
+	Map *map = new Map( header->width, header->height );
+	map->file_data = (char*)data;
+	map->file_size = size;
+	map->file_owner = std::shared_ptr<void>( data, [size]( void *p ) { munmap( p, size ); } );
+
+	const bool summed = header->version >= 2;
+	const uint64_t cost_bytes = (uint64_t)map->cost_grid.getNumPages() * COST_PAGE_SIZE * sizeof(float);
+
+	if( summed && ( header->cost_page_size != COST_PAGE_SIZE || header->cost_offset % COST_ALIGN != 0 ||
+			header->cost_offset + cost_bytes > size ||
+			header->counts_offset + Cell::num_cell_types*sizeof(uint64_t) > size ||
+			header->work_offset + num_chunks*sizeof(uint32_t) > size ) )
+	{
+		fprintf(stderr, "Map: %s is damaged\n", filename);
+		delete map;
+		return NULL;
+	}
+
+	const uint64_t *index = (const uint64_t*)( map->file_data + header->index_offset );
+
+	for( size_t i = 0; i < num_chunks; i++ )
+	{
+		if( index[i] == 0 ) continue;
+
+		if( index[i] % CHUNK_ALIGN != 0 || index[i] + sizeof(chunk_t) > size )
+		{
+			fprintf(stderr, "Map: %s is damaged\n", filename);
+			delete map;
+			return NULL;
+		}
+
+		map->chunks[i] = (chunk_t*)( map->file_data + index[i] );
+		if( !summed ) map->chunkLoaded( i );
+	}
+
+	if( summed )
+	{
+		const uint64_t *counts = (const uint64_t*)( map->file_data + header->counts_offset );
+		map->surface_counts.assign( counts, counts + Cell::num_cell_types );
+
+		map->cost_grid.usePages( (float*)( map->file_data + header->cost_offset ), map->file_owner );
+
+		// only chunks with work in them need reading now
+		const uint32_t *work = (const uint32_t*)( map->file_data + header->work_offset );
+		for( size_t i = 0; i < num_chunks; i++ )
+		{
+			if( work[i] > 0 ) map->chunkWork( i );
+		}
+	}
+
+	map->updateCostBounds();
+
+	return map;
+}
+
+/*
+ * Counts, costs and pending work for the cells of a chunk that replaced default ones
+ */
+void Map::chunkLoaded( size_t chunk )
+{
+	const size_t x0 = (chunk % chunks_wide) << CHUNK_SHIFT;
+	const size_t y0 = (chunk / chunks_wide) << CHUNK_SHIFT;
+	const int default_surface = Cell().getSurfaceId();
+
+	for( size_t y = y0; y < std::min( height, y0 + CHUNK_SIZE ); y++ )
+	{
+		for( size_t x = x0; x < std::min( width, x0 + CHUNK_SIZE ); x++ )
+		{
+			const Cell &cell = cellAt( x, y );
+			if( !cell.isBuilt() ) dirty_cells.insert( x, y );
+
+			const int surface = cell.getSurfaceId();
+			if( surface == default_surface ) continue;
+
+			surface_counts[default_surface]--;
+			surface_counts[surface]++;
+			cost_grid.set( x, y, cell.getMoveCost() );
+		}
+	}
+}
+
+/*
+ * Queue the cells of a chunk left to build
+ */
+void Map::chunkWork( size_t chunk )
+{
+	const size_t x0 = (chunk % chunks_wide) << CHUNK_SHIFT;
+	const size_t y0 = (chunk / chunks_wide) << CHUNK_SHIFT;
+
+	for( size_t y = y0; y < std::min( height, y0 + CHUNK_SIZE ); y++ )
+	{
+		for( size_t x = x0; x < std::min( width, x0 + CHUNK_SIZE ); x++ )
+		{
+			if( !cellAt( x, y ).isBuilt() ) dirty_cells.insert( x, y );
+		}
+	}
+}
+
+/*
+ * Stream the map out chunk by chunk
+ */
+bool Map::save( const char *filename )
+{
+	// written beside the real file and moved over it once complete, so a
+	// failed save or a map loaded from the same file is never disturbed
+	const std::string temp = std::string(filename) + ".tmp";
+
+	FILE *file = fopen( temp.c_str(), "wb" );
+	if( !file )
+	{
+		fprintf(stderr, "Map: Can't write %s: %s\n", temp.c_str(), strerror(errno));
+		return false;
+	}
+
+	file_header_t header;
+	memset( &header, 0, sizeof(header) );
+
+	header.magic = MAP_FILE_MAGIC;
+	header.version = MAP_FILE_VERSION;
+	header.endian = MAP_FILE_ENDIAN;
+	header.width = width;
+	header.height = height;
+	header.chunk_size = CHUNK_SIZE;
+	header.chunk_bytes = sizeof(chunk_t);
+	header.num_cell_types = Cell::num_cell_types;
+	header.index_offset = sizeof(file_header_t);
+	header.counts_offset = alignUp( header.index_offset + chunks.size()*sizeof(uint64_t) );
+	header.work_offset = alignUp( header.counts_offset + Cell::num_cell_types*sizeof(uint64_t) );
+	header.cost_offset = alignUp( header.work_offset + chunks.size()*sizeof(uint32_t), COST_ALIGN );
+	header.cost_page_size = COST_PAGE_SIZE;
+
+	const uint64_t cost_page_bytes = COST_PAGE_SIZE*sizeof(float);
+	header.data_offset = alignUp( header.cost_offset + cost_grid.getNumPages()*cost_page_bytes );
+
+	std::vector<uint64_t> counts( surface_counts.begin(), surface_counts.end() );
+
+	std::vector<uint32_t> work( chunks.size(), 0 );
+	for( CL_Point p : dirty_cells )
+		work[chunkIndex( p.x, p.y )]++;
+
+	// chunks still the same as the default need not be stored
+	const uint64_t stride = alignUp( sizeof(chunk_t) );
+	std::vector<uint64_t> index( chunks.size(), 0 );
+
+	uint64_t offset = header.data_offset;
+	for( size_t i = 0; i < chunks.size(); i++ )
+	{
+		if( chunks[i] == &empty_chunk || !memcmp( chunks[i], &empty_chunk, sizeof(chunk_t) ) ) continue;
+
+		index[i] = offset;
+		offset += stride;
+	}
+
+	static const char padding[COST_ALIGN] = {0};
+
+	// pad from the end of what was written so far up to offset
+	uint64_t written = 0;
+	auto pad = [&]( uint64_t offset )
+	{
+		const bool ok = fwrite( padding, 1, offset - written, file ) == offset - written;
+		written = offset;
+		return ok;
+	};
+
+	bool ok = fwrite( &header, sizeof(header), 1, file ) == 1 &&
+		fwrite( &index[0], sizeof(uint64_t), index.size(), file ) == index.size();
+	written = header.index_offset + index.size()*sizeof(uint64_t);
+
+	ok = ok && pad( header.counts_offset ) &&
+		fwrite( &counts[0], sizeof(uint64_t), counts.size(), file ) == counts.size();
+	written += counts.size()*sizeof(uint64_t);
+
+	ok = ok && pad( header.work_offset ) &&
+		fwrite( &work[0], sizeof(uint32_t), work.size(), file ) == work.size();
+	written += work.size()*sizeof(uint32_t);
+
+	ok = ok && pad( header.cost_offset );
+	for( size_t i = 0; ok && i < cost_grid.getNumPages(); i++ )
+	{
+		ok = fwrite( cost_grid.getPage( i ), sizeof(float), COST_PAGE_SIZE, file ) == COST_PAGE_SIZE;
+	}
+	written += cost_grid.getNumPages()*cost_page_bytes;
+
+	ok = ok && pad( header.data_offset );
+
+	for( size_t i = 0; ok && i < chunks.size(); i++ )
+	{
+		if( index[i] == 0 ) continue;
+
+		ok = fwrite( chunks[i], sizeof(chunk_t), 1, file ) == 1 &&
+			fwrite( padding, 1, stride - sizeof(chunk_t), file ) == stride - sizeof(chunk_t);
+	}
+
+	ok = ( fclose( file ) == 0 ) && ok;
+
+	if( !ok || rename( temp.c_str(), filename ) != 0 )
+	{
+		fprintf(stderr, "Map: Can't write %s: %s\n", filename, strerror(errno));
+		unlink( temp.c_str() );
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,296 @@
+/*
+ * File:	map_generate.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Procedural terrain. Two fields of value noise, height and moisture, are
+ * summed over a few octaves; low ground floods with water, high ground is
+ * lava, and the rest is grass or, where it is dry, empty ground.
+ *
+ * Every cell is a pure function of the seed and its position, so chunks can
+ * be filled in any order by any number of threads and still come out the
+ * same.
+ */
+
+#include "map/map.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// indices into Cell::Types
+#define GRASS	0
+#define LAVA	1
+#define EMPTY	2
+#define WATER	5
+
+// height below which cells are water, above which they are lava
+#define WATER_LEVEL	0.36f
+#define LAVA_LEVEL	0.66f
+
+// moisture below which dry land is empty
+#define DRY_LEVEL	0.42f
+
+typedef struct
+{
+	/// Lattice spacing is 1 << shift cells
+	int shift;
+	float amplitude;
+} octave_t;
+
+// amplitudes of each field sum to 1, so the fields stay within [0, 1)
+static const octave_t height_octaves[] =
+{
+	{ 8, 0.5f }, { 7, 0.25f }, { 6, 0.125f }, { 5, 0.0625f }, { 4, 0.0625f },
+};
+
+static const octave_t moisture_octaves[] =
+{
+	{ 9, 0.6f }, { 7, 0.3f }, { 5, 0.1f },
+};
+
+#define NUM_OCTAVES(o)	(sizeof(o) / sizeof(octave_t))
+
+// seeds of the two fields, and of each octave within them
+#define HEIGHT_SEED		0x68656967
+#define MOISTURE_SEED	0x6d6f6973
+#define OCTAVE_SEED		0x9e3779b9
+
+/*
+ * Well mixed 32 bits from a seed and a lattice point
+ */
+static uint32_t hash( uint32_t seed, uint32_t x, uint32_t y )
+{
+	uint32_t h = seed ^ (x * 0x8da6b343) ^ (y * 0xd8163841);
+	h ^= h >> 16;
+	h *= 0x7feb352d;
+	h ^= h >> 15;
+	h *= 0x846ca68b;
+	h ^= h >> 16;
+	return h;
+}
+
+static float latticeValue( uint32_t seed, uint32_t x, uint32_t y )
+{
+	return (hash( seed, x, y ) >> 8) * (1.0f / (1 << 24));
+}
+
+/*
+ * Add the octaves of one noise field over the chunk at (x0, y0) to field
+ */
+static void addNoise( float *field, size_t x0, size_t y0, uint32_t seed, const octave_t *octaves, size_t num_octaves )
+{
+	for( size_t o = 0; o < num_octaves; o++ )
+	{
+		const int shift = octaves[o].shift;
+		const uint32_t octave_seed = seed + o*OCTAVE_SEED;
+		const float scale = 1.0f / (1 << shift);
+
+		// lattice points covering the chunk, a chunk spans at most
+		// CHUNK_SIZE/spacing + 1 lattice cells
+		const size_t lx0 = x0 >> shift, ly0 = y0 >> shift;
+		const size_t span = std::max( (size_t)(CHUNK_SIZE >> shift), (size_t)1 ) + 2;
+
+		float lattice[CHUNK_SIZE + 2][CHUNK_SIZE + 2];
+		for( size_t j = 0; j < span; j++ )
+			for( size_t i = 0; i < span; i++ )
+				lattice[j][i] = octaves[o].amplitude * latticeValue( octave_seed, lx0 + i, ly0 + j );
+
+		// smoothed position of each row and column between lattice points
+		float wx[CHUNK_SIZE], wy[CHUNK_SIZE];
+		size_t ix[CHUNK_SIZE], iy[CHUNK_SIZE];
+		for( size_t i = 0; i < CHUNK_SIZE; i++ )
+		{
+			const float tx = ((x0 + i) & ((1 << shift) - 1)) * scale;
+			const float ty = ((y0 + i) & ((1 << shift) - 1)) * scale;
+			wx[i] = tx*tx*(3 - 2*tx);
+			wy[i] = ty*ty*(3 - 2*ty);
+			ix[i] = ((x0 + i) >> shift) - lx0;
+			iy[i] = ((y0 + i) >> shift) - ly0;
+		}
+
+		// blend along each lattice row once, so the cells only blend down
+		// columns
+		float rows[CHUNK_SIZE + 2][CHUNK_SIZE];
+		for( size_t j = 0; j < span; j++ )
+		{
+			for( size_t x = 0; x < CHUNK_SIZE; x++ )
+			{
+				const float *l = &lattice[j][ix[x]];
+				rows[j][x] = l[0] + wx[x]*(l[1] - l[0]);
+			}
+		}
+
+		for( size_t y = 0; y < CHUNK_SIZE; y++ )
+		{
+			const float *top = rows[iy[y]], *bottom = rows[iy[y] + 1];
+			float *out = &field[y << CHUNK_SHIFT];
+
+			for( size_t x = 0; x < CHUNK_SIZE; x++ )
+				out[x] += top[x] + wy[y]*(bottom[x] - top[x]);
+		}
+	}
+}
+
+/*
+ * The cells terrain is made of, and what they cost to cross
+ */
+typedef enum { TERRAIN_GRASS, TERRAIN_EMPTY, TERRAIN_LAVA, TERRAIN_WATER, NUM_TERRAIN } terrain_t;
+
+typedef struct
+{
+	Cell cell;
+	float cost;
+} terrain_cell_t;
+
+static terrain_cell_t terrainCell( int base, int building )
+{
+	terrain_cell_t t;
+	t.cell = Cell( base );
+
+	// lakes are finished buildings, so they are never queued as work
+	if( building >= 0 )
+	{
+		t.cell.setBuildingId( building );
+		t.cell.build( Cell::Types[building].build_cost );
+	}
+
+	t.cost = t.cell.getMoveCost();
+	return t;
+}
+
+/*
+ * Call work(i, worker) for each i below n, spread over threads workers
+ */
+static void parallelFor( size_t n, int threads, const std::function<void(size_t, int)> &work )
+{
+	std::atomic<size_t> next( 0 );
+	auto run = [&]( int worker )
+	{
+		for( size_t i = next++; i < n; i = next++ )
+			work( i, worker );
+	};
+
+	std::vector<std::thread> workers;
+	for( int t = 1; t < threads; t++ )
+		workers.push_back( std::thread( run, t ) );
+
+	run( 0 );
+
+	for( std::thread &t : workers )
+		t.join();
+}
+
+/*
+ * Generate a new map
+ */
+Map* Map::generate( size_t w, size_t h, uint32_t seed, int threads )
+{
+	if( threads <= 0 )
+		threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+	Map *map = new Map( w, h );
+	const size_t num_chunks = map->chunks.size();
+
+	std::vector< std::vector<size_t> > counts( threads, std::vector<size_t>( Cell::num_cell_types, 0 ) );
+
+	// every cost gets set, and unsharing pages isn't safe across threads
+	map->cost_grid.detach();
+
+	parallelFor( num_chunks, threads, [&]( size_t chunk, int worker ) {
+		map->generateChunk( chunk, seed, counts[worker] );
+	});
+
+	// frames look across chunk edges, so wait until every chunk is filled
+	parallelFor( num_chunks, threads, [&]( size_t chunk, int ) {
+		map->generateFrames( chunk );
+	});
+
+	map->surface_counts.assign( Cell::num_cell_types, 0 );
+	for( const std::vector<size_t> &c : counts )
+	{
+		for( size_t i = 0; i < Cell::num_cell_types; i++ )
+			map->surface_counts[i] += c[i];
+	}
+
+	map->chunks_allocated = 0;
+	for( chunk_t *chunk : map->chunks )
+	{
+		if( chunk != &empty_chunk ) map->chunks_allocated++;
+	}
+
+	map->updateCostBounds();
+
+	return map;
+}
+
+/*
+ * Terrain of one chunk, left sharing the default if that's all it is
+ */
+void Map::generateChunk( size_t chunk, uint32_t seed, std::vector<size_t> &counts )
+{
+	const size_t x0 = (chunk % chunks_wide) << CHUNK_SHIFT;
+	const size_t y0 = (chunk / chunks_wide) << CHUNK_SHIFT;
+	const size_t x1 = std::min( width, x0 + CHUNK_SIZE ), y1 = std::min( height, y0 + CHUNK_SIZE );
+
+	float heights[CHUNK_SIZE*CHUNK_SIZE] = {0};
+	float moisture[CHUNK_SIZE*CHUNK_SIZE] = {0};
+	addNoise( heights, x0, y0, seed ^ HEIGHT_SEED, height_octaves, NUM_OCTAVES(height_octaves) );
+	addNoise( moisture, x0, y0, seed ^ MOISTURE_SEED, moisture_octaves, NUM_OCTAVES(moisture_octaves) );
+
+	static const terrain_cell_t terrain[NUM_TERRAIN] =
+	{
+		terrainCell( GRASS, -1 ), terrainCell( EMPTY, -1 ), terrainCell( LAVA, -1 ), terrainCell( GRASS, WATER ),
+	};
+
+	// built up here and only copied out if it isn't all default cells, the
+	// cells past the edge of the map stay default
+	chunk_t cells( empty_chunk );
+
+	for( size_t y = y0; y < y1; y++ )
+	{
+		for( size_t x = x0; x < x1; x++ )
+		{
+			const size_t i = localIndex( x, y );
+
+			terrain_t t;
+			if( heights[i] < WATER_LEVEL ) t = TERRAIN_WATER;
+			else if( heights[i] > LAVA_LEVEL ) t = TERRAIN_LAVA;
+			else t = moisture[i] < DRY_LEVEL ? TERRAIN_EMPTY : TERRAIN_GRASS;
+
+			cells.cells[i] = terrain[t].cell;
+			cost_grid.set( x, y, terrain[t].cost );
+			counts[terrain[t].cell.getSurfaceId()]++;
+		}
+	}
+
+	if( memcmp( &cells, &empty_chunk, sizeof(chunk_t) ) )
+		chunks[chunk] = new chunk_t( cells );
+}
+
+/*
+ * Frames of the cells in one chunk, reading its neighbours but writing only
+ * its own cells
+ */
+void Map::generateFrames( size_t chunk )
+{
+	if( chunks[chunk] == &empty_chunk ) return;
+
+	const size_t x0 = (chunk % chunks_wide) << CHUNK_SHIFT;
+	const size_t y0 = (chunk / chunks_wide) << CHUNK_SHIFT;
+
+	for( size_t y = y0; y < std::min( height, y0 + CHUNK_SIZE ); y++ )
+	{
+		for( size_t x = x0; x < std::min( width, x0 + CHUNK_SIZE ); x++ )
+		{
+			int frame = cellAt(x, y).getBuildingType();
+			if( frame < 0 )
+				frame = find_neighbors(frame, x, y);
+
+			chunks[chunk]->frames[localIndex(x, y)] = frame;
+		}
+	}
+}
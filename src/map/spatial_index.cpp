@@ -0,0 +1,172 @@
+/*
+ * File:	spatial_index.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Entities on the map bucketed by position
+ */
+
+#include "map/spatial_index.h"
+
+#include <algorithm>
+#include <tuple>
+
+SpatialIndex::SpatialIndex( size_t w, size_t h )
+	: width(w), height(h), count(0)
+{
+	buckets_wide = std::max( (size_t)1, (w + BUCKET_SIZE - 1) >> BUCKET_SHIFT );
+	buckets_high = std::max( (size_t)1, (h + BUCKET_SIZE - 1) >> BUCKET_SHIFT );
+	buckets.resize( buckets_wide*buckets_high );
+}
+
+size_t SpatialIndex::bucketIndex( int x, int y ) const
+{
+	const size_t bx = std::min( (size_t)std::max( x, 0 ) >> BUCKET_SHIFT, buckets_wide - 1 );
+	const size_t by = std::min( (size_t)std::max( y, 0 ) >> BUCKET_SHIFT, buckets_high - 1 );
+	return by*buckets_wide + bx;
+}
+
+void SpatialIndex::insert( Entity *entity, int x, int y )
+{
+	entry_t entry = { entity, x, y };
+	buckets[bucketIndex(x, y)].push_back( entry );
+	count++;
+}
+
+void SpatialIndex::erase( Entity *entity, int x, int y )
+{
+	std::vector<entry_t> &bucket = buckets[bucketIndex(x, y)];
+
+	for( size_t i = 0; i < bucket.size(); i++ )
+	{
+		if( bucket[i].entity != entity ) continue;
+
+		bucket[i] = bucket.back();
+		bucket.pop_back();
+		count--;
+		return;
+	}
+}
+
+/*
+ * Moves within a bucket only update the position
+ */
+void SpatialIndex::move( Entity *entity, int old_x, int old_y, int x, int y )
+{
+	const size_t from = bucketIndex( old_x, old_y ), to = bucketIndex( x, y );
+
+	if( from != to )
+	{
+		erase( entity, old_x, old_y );
+		insert( entity, x, y );
+		return;
+	}
+
+	for( entry_t &entry : buckets[from] )
+	{
+		if( entry.entity != entity ) continue;
+
+		entry.x = x;
+		entry.y = y;
+		return;
+	}
+}
+
+void SpatialIndex::queryRect( int x0, int y0, int x1, int y1, std::vector<Entity*> &out ) const
+{
+	if( x1 < x0 || y1 < y0 ) return;
+
+	const size_t b0 = bucketIndex( x0, y0 ), b1 = bucketIndex( x1, y1 );
+
+	for( size_t by = b0 / buckets_wide; by <= b1 / buckets_wide; by++ )
+	{
+		for( size_t bx = b0 % buckets_wide; bx <= b1 % buckets_wide; bx++ )
+		{
+			for( const entry_t &entry : buckets[by*buckets_wide + bx] )
+			{
+				if( entry.x >= x0 && entry.x <= x1 && entry.y >= y0 && entry.y <= y1 )
+					out.push_back( entry.entity );
+			}
+		}
+	}
+}
+
+void SpatialIndex::queryRadius( int x, int y, double radius, std::vector<Entity*> &out ) const
+{
+	if( radius < 0 ) return;
+
+	const int r = (int)radius;
+	const double r2 = radius*radius;
+
+	const size_t b0 = bucketIndex( x - r, y - r ), b1 = bucketIndex( x + r, y + r );
+
+	for( size_t by = b0 / buckets_wide; by <= b1 / buckets_wide; by++ )
+	{
+		for( size_t bx = b0 % buckets_wide; bx <= b1 % buckets_wide; bx++ )
+		{
+			for( const entry_t &entry : buckets[by*buckets_wide + bx] )
+			{
+				const double dx = entry.x - x, dy = entry.y - y;
+				if( dx*dx + dy*dy <= r2 )
+					out.push_back( entry.entity );
+			}
+		}
+	}
+}
+
+/*
+ * Search rings of buckets outward from the one holding (x, y), until no
+ * bucket further out can hold anything nearer than the k found so far
+ */
+void SpatialIndex::nearest( int x, int y, size_t k, std::vector<Entity*> &out, const filter_t &filter ) const
+{
+	out.clear();
+	if( k == 0 || count == 0 ) return;
+
+	// distance squared, then row major position, then the order they were
+	// found in, never where the entities happen to sit in memory
+	typedef std::tuple<long, int, int, size_t, Entity*> candidate_t;
+	std::vector<candidate_t> found;
+
+	const size_t centre = bucketIndex( x, y );
+	const long cx = centre % buckets_wide, cy = centre / buckets_wide;
+	const long max_ring = std::max( std::max( cx, (long)buckets_wide - 1 - cx ), std::max( cy, (long)buckets_high - 1 - cy ) );
+
+	for( long ring = 0; ring <= max_ring; ring++ )
+	{
+		for( long by = cy - ring; by <= cy + ring; by++ )
+		{
+			if( by < 0 || by >= (long)buckets_high ) continue;
+
+			// only the edge of the ring, the inside was searched already
+			const long step = ( by == cy - ring || by == cy + ring ) ? 1 : std::max( 2*ring, 1L );
+
+			for( long bx = cx - ring; bx <= cx + ring; bx += step )
+			{
+				if( bx < 0 || bx >= (long)buckets_wide ) continue;
+
+				for( const entry_t &entry : buckets[by*buckets_wide + bx] )
+				{
+					if( filter && !filter( entry.entity ) ) continue;
+
+					const long dx = entry.x - x, dy = entry.y - y;
+					found.push_back( candidate_t( dx*dx + dy*dy, entry.y, entry.x, found.size(), entry.entity ) );
+				}
+			}
+		}
+
+		if( found.size() < k ) continue;
+
+		// every cell in the next ring is at least this far away
+		const long closest = ring*BUCKET_SIZE + 1;
+
+		std::nth_element( found.begin(), found.begin() + k - 1, found.end() );
+		if( std::get<0>( found[k - 1] ) < closest*closest ) break;
+	}
+
+	const size_t n = std::min( k, found.size() );
+	std::partial_sort( found.begin(), found.begin() + n, found.end() );
+
+	for( size_t i = 0; i < n; i++ )
+		out.push_back( std::get<4>( found[i] ) );
+}
@@ -0,0 +1,89 @@
+/*
+ * File:	spatial_index.h
+ *
+ * Author:	James Letendre
+ *
+ * Entities on the map bucketed by position, so the ones in an area or
+ * nearest a cell are found without looking at the rest. The map is cut into
+ * square buckets of BUCKET_SIZE cells a side, each holding the entities
+ * standing in it.
+ */
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <stdlib.h>
+#include <functional>
+#include <vector>
+
+// buckets are BUCKET_SIZE cells a side
+#define BUCKET_SHIFT	4
+#define BUCKET_SIZE		(1 << BUCKET_SHIFT)
+
+class Entity;
+
+class SpatialIndex
+{
+	public:
+		/// Entities a query may skip, true to keep one
+		typedef std::function<bool(Entity*)> filter_t;
+
+		/**
+		 * SpatialIndex(w, h)
+		 *
+		 * Empty index over a w by h map
+		 */
+		SpatialIndex( size_t w, size_t h );
+
+		/**
+		 * Add an entity standing at (x, y)
+		 */
+		void insert( Entity *entity, int x, int y );
+
+		/**
+		 * Remove an entity last placed at (x, y)
+		 */
+		void erase( Entity *entity, int x, int y );
+
+		/**
+		 * An entity moved from (old_x, old_y) to (x, y)
+		 */
+		void move( Entity *entity, int old_x, int old_y, int x, int y );
+
+		/**
+		 * Append to out the entities in the rectangle from (x0, y0) to
+		 * (x1, y1), corners included
+		 */
+		void queryRect( int x0, int y0, int x1, int y1, std::vector<Entity*> &out ) const;
+
+		/**
+		 * Append to out the entities no more than radius cells from (x, y)
+		 */
+		void queryRadius( int x, int y, double radius, std::vector<Entity*> &out ) const;
+
+		/**
+		 * Replace out with the k entities nearest (x, y) that pass filter,
+		 * nearest first. Equally near entities come in row major order of
+		 * where they stand, then in the order they entered their bucket.
+		 */
+		void nearest( int x, int y, size_t k, std::vector<Entity*> &out, const filter_t &filter = filter_t() ) const;
+
+		size_t size() const { return count; }
+
+	private:
+		typedef struct
+		{
+			Entity *entity;
+			int x, y;
+		} entry_t;
+
+		/// Bucket holding a cell, cells off the map go to the nearest bucket
+		size_t bucketIndex( int x, int y ) const;
+
+		size_t width, height;
+		size_t buckets_wide, buckets_high;
+
+		std::vector< std::vector<entry_t> > buckets;
+		size_t count;
+};
+
+#endif
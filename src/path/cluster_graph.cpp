@@ -0,0 +1,686 @@
+/*
+ * File:	cluster_graph.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Hierarchical path finding (HPA*) over a grid of move costs
+ */
+
+#include "path/cluster_graph.h"
+#include "path/grid_moves.h"
+#include "map/cost_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// open runs shorter than this get one entrance in the middle, longer ones get
+// an entrance at each end
+#define MIN_DOUBLE_ENTRANCE	6
+
+// inflate the abstract heuristic, routes may cost up to this factor more
+// than the best one but far fewer entrances get expanded
+#define HEURISTIC_WEIGHT	1.1
+
+// refined hops a context keeps before starting over
+#define MAX_CACHED_HOPS		16384
+
+#define INF	std::numeric_limits<double>::infinity()
+
+ClusterGraph::Context::Context( PathSearch *search )
+	: search(search), generation(0), nodes_expanded(0)
+{
+}
+
+ClusterGraph::ClusterGraph( const CostGrid *grid, int cluster_size )
+	: grid(grid), cluster_size(std::max(2, std::min(cluster_size, 256))), search(grid)
+{
+	clusters_wide = (grid->getWidth() + this->cluster_size - 1) / this->cluster_size;
+	clusters_high = (grid->getHeight() + this->cluster_size - 1) / this->cluster_size;
+
+	const size_t num_clusters = clusters_wide * clusters_high;
+
+	clusters.resize( num_clusters );
+	for( size_t i = 0; i < num_clusters; i++ )
+	{
+		clusters[i].dirty = true;
+		clusters[i].version = 0;
+		clusters[i].num_nodes = 0;
+		std::fill( clusters[i].side_start, clusters[i].side_start + NUM_SIDES + 1, 0 );
+		dirty_clusters.push_back( i );
+	}
+
+	east_borders.resize( num_clusters );
+	south_borders.resize( num_clusters );
+	east_dirty.assign( num_clusters, false );
+	south_dirty.assign( num_clusters, false );
+
+	// every border needs to be built before the first query
+	for( size_t i = 0; i < num_clusters; i++ )
+	{
+		if( (int)(i % clusters_wide) < clusters_wide-1 )
+		{
+			east_dirty[i] = true;
+			dirty_borders.push_back( i << 1 );
+		}
+		if( (int)(i / clusters_wide) < clusters_high-1 )
+		{
+			south_dirty[i] = true;
+			dirty_borders.push_back( (i << 1) | 1 );
+		}
+	}
+
+	max_nodes = NUM_SIDES * (this->cluster_size/2 + 1);
+
+	for( int i = 0; i < NUM_SUCCESSORS; i++ )
+		local_offsets[i] = successors[i].dy*(this->cluster_size + 2) + successors[i].dx;
+
+	context = new Context( &search );
+}
+
+ClusterGraph::~ClusterGraph()
+{
+	delete context;
+}
+
+void ClusterGraph::setGrid( const CostGrid *grid )
+{
+	this->grid = grid;
+	search.setGrid( grid );
+}
+
+double ClusterGraph::moveCost( int x, int y ) const
+{
+	return grid->get(x, y);
+}
+
+void ClusterGraph::markDirty( int cluster )
+{
+	if( clusters[cluster].dirty ) return;
+
+	clusters[cluster].dirty = true;
+	dirty_clusters.push_back( cluster );
+}
+
+void ClusterGraph::markBorder( int border, bool east )
+{
+	std::vector<bool> &dirty = east ? east_dirty : south_dirty;
+	if( dirty[border] ) return;
+
+	dirty[border] = true;
+	dirty_borders.push_back( (border << 1) | (east ? 0 : 1) );
+}
+
+/*
+ * Mark the cells inside rect as changed
+ */
+void ClusterGraph::regionChanged( const CL_Rect &rect )
+{
+	const int left = std::max( rect.left, 0 ), top = std::max( rect.top, 0 );
+	const int right = std::min( rect.right, (int)grid->getWidth() );
+	const int bottom = std::min( rect.bottom, (int)grid->getHeight() );
+	if( left >= right || top >= bottom ) return;
+
+	for( int cy = top / cluster_size; cy <= (bottom - 1) / cluster_size; cy++ )
+	{
+		for( int cx = left / cluster_size; cx <= (right - 1) / cluster_size; cx++ )
+		{
+			const int c = cy*clusters_wide + cx;
+			markDirty( c );
+
+			// cells on a border can add or remove entrances
+			const int first_x = cx*cluster_size, last_x = first_x + cluster_size-1;
+			if( last_x >= left && last_x < right && cx < clusters_wide-1 ) markBorder( c, true );
+			if( first_x >= left && first_x < right && cx > 0 ) markBorder( c - 1, true );
+
+			const int first_y = cy*cluster_size, last_y = first_y + cluster_size-1;
+			if( last_y >= top && last_y < bottom && cy < clusters_high-1 ) markBorder( c, false );
+			if( first_y >= top && first_y < bottom && cy > 0 ) markBorder( c - clusters_wide, false );
+		}
+	}
+}
+
+/*
+ * Bring every changed border and cluster up to date
+ */
+void ClusterGraph::update()
+{
+	repairBorders();
+
+	for( uint32_t c : dirty_clusters )
+		buildCluster( c );
+	dirty_clusters.clear();
+}
+
+void ClusterGraph::repairBorders()
+{
+	for( uint32_t b : dirty_borders )
+	{
+		buildBorder( b >> 1, !(b & 1) );
+	}
+	dirty_borders.clear();
+}
+
+/*
+ * Place entrances along the open runs of a border
+ */
+void ClusterGraph::buildBorder( size_t border, bool east )
+{
+	const int cx = border % clusters_wide, cy = border / clusters_wide;
+
+	std::vector<uint8_t> &entrances( east ? east_borders[border] : south_borders[border] );
+	entrances.clear();
+
+	// first cell on each side of the border, and the direction along it
+	int ax, ay, bx, by, dx, dy, len;
+	if( east )
+	{
+		ax = cx*cluster_size + cluster_size-1;	ay = cy*cluster_size;
+		bx = ax+1;								by = ay;
+		dx = 0; dy = 1;
+		len = std::min( cluster_size, (int)grid->getHeight() - ay );
+
+		east_dirty[border] = false;
+		markDirty( border+1 );
+	}
+	else
+	{
+		ax = cx*cluster_size;	ay = cy*cluster_size + cluster_size-1;
+		bx = ax;				by = ay+1;
+		dx = 1; dy = 0;
+		len = std::min( cluster_size, (int)grid->getWidth() - ax );
+
+		south_dirty[border] = false;
+		markDirty( border+clusters_wide );
+	}
+	markDirty( border );
+
+	int run_start = -1;
+	for( int i = 0; i <= len; i++ )
+	{
+		bool open = i < len && moveCost(ax + i*dx, ay + i*dy) >= 0 && moveCost(bx + i*dx, by + i*dy) >= 0;
+
+		if( open && run_start < 0 )
+		{
+			run_start = i;
+		}
+		else if( !open && run_start >= 0 )
+		{
+			int run = i - run_start;
+			if( run < MIN_DOUBLE_ENTRANCE )
+			{
+				entrances.push_back( run_start + run/2 );
+			}
+			else
+			{
+				entrances.push_back( run_start );
+				entrances.push_back( i-1 );
+			}
+			run_start = -1;
+		}
+	}
+}
+
+const std::vector<uint8_t>* ClusterGraph::sideEntrances( int cluster, int side ) const
+{
+	const int cx = cluster % clusters_wide, cy = cluster / clusters_wide;
+
+	switch( side )
+	{
+		case NORTH:	return cy > 0 ? &south_borders[cluster - clusters_wide] : NULL;
+		case EAST:	return cx < clusters_wide-1 ? &east_borders[cluster] : NULL;
+		case SOUTH:	return cy < clusters_high-1 ? &south_borders[cluster] : NULL;
+		case WEST:	return cx > 0 ? &east_borders[cluster - 1] : NULL;
+	}
+	return NULL;
+}
+
+CL_Rect ClusterGraph::clusterRect( int cluster ) const
+{
+	const int x0 = (cluster % clusters_wide) * cluster_size;
+	const int y0 = (cluster / clusters_wide) * cluster_size;
+
+	return CL_Rect( x0, y0,
+			std::min( x0 + cluster_size, (int)grid->getWidth() ),
+			std::min( y0 + cluster_size, (int)grid->getHeight() ) );
+}
+
+/*
+ * The entrance on the other side of the border, as an abstract node. Both
+ * clusters number the entrances of a border in the same order.
+ */
+uint32_t ClusterGraph::across( int cluster, int node ) const
+{
+	const cluster_t &c( clusters[cluster] );
+
+	int side = 0;
+	while( node >= c.side_start[side + 1] ) side++;
+
+	int other, other_side;
+	switch( side )
+	{
+		case NORTH:	other = cluster - clusters_wide;	other_side = SOUTH;	break;
+		case EAST:	other = cluster + 1;				other_side = WEST;	break;
+		case SOUTH:	other = cluster + clusters_wide;	other_side = NORTH;	break;
+		default:	other = cluster - 1;				other_side = EAST;	break;
+	}
+
+	return other*max_nodes + clusters[other].side_start[other_side] + node - c.side_start[side];
+}
+
+/*
+ * Copy a cluster's costs, with everything outside it impassable
+ */
+void ClusterGraph::loadCluster( int cluster, local_t &local ) const
+{
+	const int stride = cluster_size + 2;
+
+	local.rect = clusterRect( cluster );
+	local.cells.assign( stride*stride, -1 );
+	local.dist.resize( stride*stride );
+
+	for( int y = local.rect.top; y < local.rect.bottom; y++ )
+	{
+		float *row = &local.cells[localIndex( local, local.rect.left, y )];
+		for( int x = local.rect.left; x < local.rect.right; x++ )
+			*row++ = grid->get(x, y);
+	}
+}
+
+/*
+ * Dijkstra over a loaded cluster. Forward gives the cost from (x,y) to each
+ * cell, backward the cost from each cell to (x,y). Moving costs the cell
+ * being left. With a target the search is guided towards it and stops once
+ * it is reached, leaving exact costs only along the way there.
+ */
+void ClusterGraph::localDijkstra( local_t &local, int x, int y, bool forward, const CL_Point *target ) const
+{
+	std::fill( local.dist.begin(), local.dist.end(), INF );
+	local.queue.clear();
+
+	const int stride = cluster_size + 2;
+	const uint32_t src = localIndex( local, x, y );
+	if( forward && local.cells[src] < 0 ) return;
+
+	// no step is cheaper than the cheapest cell, so the estimate stays exact
+	// enough for localDescend to follow
+	const uint32_t goal = target ? localIndex( local, target->x, target->y ) : 0;
+	const double h_scale = target ? grid->getMinCost() : 0;
+	auto estimate = [&]( uint32_t id ) -> double
+	{
+		return h_scale * octile_distance( (int)(id % stride) - (int)(goal % stride), (int)(id / stride) - (int)(goal / stride) );
+	};
+
+	local.dist[src] = 0;
+	local.queue.push_back( (node_t){src, estimate( src )} );
+
+	while( !local.queue.empty() )
+	{
+		std::pop_heap( local.queue.begin(), local.queue.end(), best_weight_compare<node_t> );
+		const node_t head = local.queue.back();
+		local.queue.pop_back();
+
+		if( head.weight > local.dist[head.id] + estimate( head.id ) ) continue;
+		if( target && head.id == goal ) return;
+
+		const double head_move = local.cells[head.id];
+
+		// the border is impassable, so neighbours need no bounds checks
+		for( int i = 0; i < NUM_SUCCESSORS; i++ )
+		{
+			const uint32_t child = head.id + local_offsets[i];
+
+			const double p = local.cells[child];
+			if( p < 0 ) continue;
+
+			const double child_cost = local.dist[head.id] + successors[i].weight * (forward ? head_move : p);
+			if( local.dist[child] <= child_cost ) continue;
+
+			local.dist[child] = child_cost;
+			local.queue.push_back( (node_t){child, child_cost + estimate( child )} );
+			std::push_heap( local.queue.begin(), local.queue.end(), best_weight_compare<node_t> );
+		}
+	}
+}
+
+/*
+ * Follow the cheapest neighbour down a backward Dijkstra from (x,y) to
+ * where it started
+ */
+double ClusterGraph::localDescend( const local_t &local, int x, int y, std::vector<CL_Point> &cells ) const
+{
+	uint32_t cur = localIndex( local, x, y );
+	const double total = local.dist[cur];
+	if( total == INF ) return INF;
+
+	const int stride = cluster_size + 2;
+
+	while( local.dist[cur] > 0 )
+	{
+		const double move = local.cells[cur];
+
+		uint32_t best = cur;
+		double best_cost = INF;
+		for( int i = 0; i < NUM_SUCCESSORS; i++ )
+		{
+			const uint32_t child = cur + local_offsets[i];
+			if( local.dist[child] == INF ) continue;
+
+			const double c = successors[i].weight * move + local.dist[child];
+			if( c < best_cost )
+			{
+				best = child;
+				best_cost = c;
+			}
+		}
+
+		cur = best;
+		cells.push_back( CL_Point( local.rect.left + (int)(cur % stride) - 1, local.rect.top + (int)(cur / stride) - 1 ) );
+	}
+
+	return total;
+}
+
+/*
+ * Recompute the entrances of a cluster and the costs between them
+ */
+void ClusterGraph::buildCluster( int cluster )
+{
+	cluster_t &c( clusters[cluster] );
+	const CL_Rect rect = clusterRect( cluster );
+
+	c.nodes.clear();
+	for( int side = 0; side < NUM_SIDES; side++ )
+	{
+		c.side_start[side] = c.nodes.size();
+
+		const std::vector<uint8_t> *e = sideEntrances( cluster, side );
+		if( !e ) continue;
+
+		for( uint8_t offset : *e )
+		{
+			switch( side )
+			{
+				case NORTH:	c.nodes.push_back( CL_Point( rect.left + offset, rect.top ) );					break;
+				case EAST:	c.nodes.push_back( CL_Point( rect.left + cluster_size-1, rect.top + offset ) );	break;
+				case SOUTH:	c.nodes.push_back( CL_Point( rect.left + offset, rect.top + cluster_size-1 ) );	break;
+				case WEST:	c.nodes.push_back( CL_Point( rect.left, rect.top + offset ) );					break;
+			}
+		}
+	}
+	c.side_start[NUM_SIDES] = c.nodes.size();
+	c.num_nodes = c.nodes.size();
+
+	c.edges.assign( c.num_nodes * c.num_nodes, INF );
+
+	loadCluster( cluster, build_local );
+	for( int to = 0; to < c.num_nodes; to++ )
+	{
+		localDijkstra( build_local, c.nodes[to].x, c.nodes[to].y, false );
+
+		for( int from = 0; from < c.num_nodes; from++ )
+		{
+			if( from == to ) continue;
+			c.edges[from*c.num_nodes + to] = build_local.dist[localIndex( build_local, c.nodes[from].x, c.nodes[from].y )];
+		}
+	}
+
+	c.version++;
+	c.dirty = false;
+}
+
+/*
+ * Cells of one hop inside a cluster, from the cache when both ends are
+ * entrances. Nodes are -1 for the start and goal.
+ */
+bool ClusterGraph::refineHop( Context &context, int cluster, int from_node, int to_node,
+		int from_x, int from_y, int to_x, int to_y, double &cost ) const
+{
+	const bool cacheable = from_node >= 0 && to_node >= 0;
+	const uint64_t key = ((uint64_t)cluster*max_nodes + from_node)*max_nodes + to_node;
+
+	if( cacheable )
+	{
+		auto found = context.hops.find( key );
+		if( found != context.hops.end() && found->second.version == clusters[cluster].version )
+		{
+			const Context::hop_t &hop( found->second );
+			context.refined.insert( context.refined.end(), hop.cells.begin(), hop.cells.end() );
+			cost = hop.cost;
+			return true;
+		}
+	}
+
+	const size_t first = context.refined.size();
+
+	loadCluster( cluster, context.local );
+	const CL_Point from( from_x, from_y );
+	localDijkstra( context.local, to_x, to_y, false, &from );
+	cost = localDescend( context.local, from_x, from_y, context.refined );
+
+	if( cost == INF ) return false;
+
+	if( cacheable )
+	{
+		if( context.hops.size() >= MAX_CACHED_HOPS )
+			context.hops.clear();
+
+		Context::hop_t &hop( context.hops[key] );
+		hop.version = clusters[cluster].version;
+		hop.cost = cost;
+		hop.cells.assign( context.refined.begin() + first, context.refined.end() );
+	}
+
+	return true;
+}
+
+size_t ClusterGraph::getNodesExpanded() const
+{
+	return context->getNodesExpanded();
+}
+
+bool ClusterGraph::findPath( int start_x, int start_y, int goal_x, int goal_y,
+		std::vector<CL_Point> &path, double *cost )
+{
+	update();
+	return findPath( *context, start_x, start_y, goal_x, goal_y, path, cost );
+}
+
+bool ClusterGraph::findPath( Context &context, int start_x, int start_y, int goal_x, int goal_y,
+		std::vector<CL_Point> &path, double *cost ) const
+{
+	context.nodes_expanded = 0;
+
+	// nothing to gain for short trips
+	if( std::max( abs(goal_x - start_x), abs(goal_y - start_y) ) < 2*cluster_size )
+	{
+		context.search->setGrid( grid );
+		bool found = context.search->findPath( start_x, start_y, goal_x, goal_y, path, cost );
+		context.nodes_expanded = context.search->getNodesExpanded();
+		return found;
+	}
+
+	if( start_x < 0 || (size_t)start_x >= grid->getWidth() || start_y < 0 || (size_t)start_y >= grid->getHeight() ||
+			goal_x < 0 || (size_t)goal_x >= grid->getWidth() || goal_y < 0 || (size_t)goal_y >= grid->getHeight() )
+	{
+		if (cost) *cost = INF;
+		return false;
+	}
+
+	// abstract search storage
+	const uint32_t start_node = clusters.size() * max_nodes;
+	const uint32_t goal_node = start_node + 1;
+
+	std::vector<uint32_t> &open_stamp( context.open_stamp ), &closed_stamp( context.closed_stamp );
+	std::vector<double> &costs( context.costs );
+	std::vector<uint32_t> &parents( context.parents );
+	std::vector<node_t> &queue( context.queue );
+
+	if( open_stamp.size() != start_node + 2 )
+	{
+		open_stamp.assign( start_node + 2, 0 );
+		closed_stamp.assign( start_node + 2, 0 );
+		costs.resize( start_node + 2 );
+		parents.resize( start_node + 2 );
+		context.start_costs.resize( max_nodes );
+		context.goal_costs.resize( max_nodes );
+		context.generation = 0;
+	}
+	if( ++context.generation == 0 )
+	{
+		std::fill( open_stamp.begin(), open_stamp.end(), 0 );
+		std::fill( closed_stamp.begin(), closed_stamp.end(), 0 );
+		context.generation = 1;
+	}
+	const uint32_t generation = context.generation;
+	queue.clear();
+
+	const int start_cluster = clusterAt( start_x, start_y );
+	const int goal_cluster = clusterAt( goal_x, goal_y );
+	const cluster_t &start_c( clusters[start_cluster] ), &goal_c( clusters[goal_cluster] );
+
+	// costs from the start to the entrances of its cluster
+	local_t &local( context.local );
+	loadCluster( start_cluster, local );
+	localDijkstra( local, start_x, start_y, true );
+	for( int i = 0; i < start_c.num_nodes; i++ )
+		context.start_costs[i] = local.dist[localIndex( local, start_c.nodes[i].x, start_c.nodes[i].y )];
+
+	// and from the entrances of the goal cluster to the goal
+	loadCluster( goal_cluster, local );
+	localDijkstra( local, goal_x, goal_y, false );
+	for( int i = 0; i < goal_c.num_nodes; i++ )
+		context.goal_costs[i] = local.dist[localIndex( local, goal_c.nodes[i].x, goal_c.nodes[i].y )];
+
+	// no step can be cheaper than the cheapest cell on the map
+	const double h_scale = HEURISTIC_WEIGHT * grid->getMinCost();
+
+	auto relax = [&]( uint32_t id, double g, uint32_t parent, const CL_Point &at )
+	{
+		if( closed_stamp[id] == generation ) return;
+		if( open_stamp[id] == generation && costs[id] <= g ) return;
+
+		open_stamp[id] = generation;
+		costs[id] = g;
+		parents[id] = parent;
+
+		// among equal estimates prefer the node furthest along
+		queue.push_back( (node_t){id, g + h_scale*octile_distance(goal_x - at.x, goal_y - at.y) - g*1e-9} );
+		std::push_heap( queue.begin(), queue.end(), best_weight_compare<node_t> );
+	};
+
+	open_stamp[start_node] = generation;
+	costs[start_node] = 0;
+	queue.push_back( (node_t){start_node, 0} );
+
+	for(;;)
+	{
+		if( queue.empty() )
+		{
+			if (cost) *cost = INF;
+			return false;
+		}
+
+		std::pop_heap( queue.begin(), queue.end(), best_weight_compare<node_t> );
+		node_t head = queue.back();
+		queue.pop_back();
+
+		if( head.id == goal_node ) break;
+
+		if( closed_stamp[head.id] == generation ) continue;
+		closed_stamp[head.id] = generation;
+
+		context.nodes_expanded++;
+
+		const double head_cost = costs[head.id];
+
+		if( head.id == start_node )
+		{
+			for( int i = 0; i < start_c.num_nodes; i++ )
+			{
+				if( context.start_costs[i] == INF ) continue;
+				relax( start_cluster*max_nodes + i, context.start_costs[i], start_node, start_c.nodes[i] );
+			}
+			continue;
+		}
+
+		const int cluster = head.id / max_nodes;
+		const int node = head.id % max_nodes;
+		const cluster_t &c( clusters[cluster] );
+
+		// other entrances of this cluster
+		const float *edges = &c.edges[node*c.num_nodes];
+		for( int to = 0; to < c.num_nodes; to++ )
+		{
+			if( to == node || edges[to] == INF ) continue;
+			relax( cluster*max_nodes + to, head_cost + edges[to], head.id, c.nodes[to] );
+		}
+
+		// the goal, if we're in its cluster
+		if( cluster == goal_cluster && context.goal_costs[node] != INF )
+		{
+			relax( goal_node, head_cost + context.goal_costs[node], head.id, CL_Point( goal_x, goal_y ) );
+		}
+
+		// step across the border to the paired entrance
+		const uint32_t other = across( cluster, node );
+		relax( other, head_cost + moveCost( c.nodes[node].x, c.nodes[node].y ), head.id,
+				clusters[other / max_nodes].nodes[other % max_nodes] );
+	}
+
+	//
+	// Refine the abstract route into cells, one cluster at a time
+	//
+	std::vector<uint32_t> &route( context.route );
+	route.clear();
+	for( uint32_t id = goal_node; id != start_node; id = parents[id] )
+	{
+		route.push_back( id );
+	}
+	route.push_back( start_node );
+	std::reverse( route.begin(), route.end() );
+
+	context.refined.clear();
+	double total = 0;
+
+	int from_x = start_x, from_y = start_y, from_cluster = start_cluster, from_node = -1;
+	for( size_t i = 1; i < route.size(); i++ )
+	{
+		int to_x = goal_x, to_y = goal_y, to_cluster = goal_cluster, to_node = -1;
+		if( route[i] != goal_node )
+		{
+			to_cluster = route[i] / max_nodes;
+			to_node = route[i] % max_nodes;
+			to_x = clusters[to_cluster].nodes[to_node].x;
+			to_y = clusters[to_cluster].nodes[to_node].y;
+		}
+
+		if( to_cluster != from_cluster )
+		{
+			// border crossing, a single orthogonal step
+			total += moveCost( from_x, from_y );
+			context.refined.push_back( CL_Point(to_x, to_y) );
+		}
+		else if( to_x != from_x || to_y != from_y )
+		{
+			double hop_cost;
+			if( !refineHop( context, to_cluster, from_node, to_node, from_x, from_y, to_x, to_y, hop_cost ) )
+			{
+				if (cost) *cost = INF;
+				return false;
+			}
+
+			total += hop_cost;
+		}
+
+		from_x = to_x;
+		from_y = to_y;
+		from_cluster = to_cluster;
+		from_node = to_node;
+	}
+
+	if (cost) *cost = total;
+
+	path.assign( context.refined.rbegin(), context.refined.rend() );
+	return true;
+}
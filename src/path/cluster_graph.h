@@ -0,0 +1,244 @@
+/*
+ * File:	cluster_graph.h
+ *
+ * Author:	James Letendre
+ *
+ * Hierarchical path finding (HPA*) over a grid of move costs. The grid is
+ * cut into square clusters, entrances are placed along the open parts of the
+ * borders between clusters, and the cost between entrances of a cluster is
+ * cached. Long queries are routed over the entrances first and then refined
+ * cluster by cluster.
+ *
+ * Changed cells are rebuilt by update(), ahead of the queries. Queries only
+ * read the graph, so any number may run at once between updates as long as
+ * each has its own Context.
+ */
+#ifndef CLUSTER_GRAPH_H
+#define CLUSTER_GRAPH_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <ClanLib/core.h>
+
+#include "path/path_search.h"
+
+class CostGrid;
+
+class ClusterGraph
+{
+	public:
+		class Context;
+
+		/**
+		 * ClusterGraph(grid, cluster_size)
+		 *
+		 * Create a cluster graph over grid. Nothing is computed until the
+		 * first update.
+		 */
+		ClusterGraph( const CostGrid *grid, int cluster_size = 32 );
+		~ClusterGraph();
+
+		/**
+		 * Follow a newer copy of the same grid. Cells that differ must still
+		 * be reported through regionChanged.
+		 */
+		void setGrid( const CostGrid *grid );
+
+		/**
+		 * Mark the cells inside rect as changed, only the clusters and
+		 * borders it overlaps are rebuilt
+		 */
+		void regionChanged( const CL_Rect &rect );
+
+		/**
+		 * Rebuild the borders and clusters changed since the last update, or
+		 * all of them the first time. No query may run meanwhile.
+		 */
+		void update();
+
+		/**
+		 * True if no cluster is waiting for update()
+		 */
+		bool isCurrent() const { return dirty_borders.empty() && dirty_clusters.empty(); }
+
+		/**
+		 * Find a path from start to goal, same conventions as
+		 * PathSearch::findPath. Short queries go straight to the context's
+		 * plain search. Clusters not yet updated are searched as they were
+		 * last built.
+		 */
+		bool findPath( Context &context, int start_x, int start_y, int goal_x, int goal_y,
+				std::vector<CL_Point> &path, double *cost = NULL ) const;
+
+		/**
+		 * Update, then find a path with the graph's own context
+		 */
+		bool findPath( int start_x, int start_y, int goal_x, int goal_y,
+				std::vector<CL_Point> &path, double *cost = NULL );
+
+		/**
+		 * Number of abstract nodes expanded by the last query on the graph's
+		 * own context
+		 */
+		size_t getNodesExpanded() const;
+
+		int getClusterSize() const { return cluster_size; }
+
+	private:
+		// sides of a cluster, in the order their entrances are numbered
+		enum { NORTH, EAST, SOUTH, WEST, NUM_SIDES };
+
+		typedef struct
+		{
+			uint32_t id;
+			double weight;
+		} node_t;
+
+		typedef struct
+		{
+			/// Entrance costs need recomputing
+			bool dirty;
+
+			/// Bumped each rebuild, so refined hops cached against an older
+			/// build are not used
+			uint32_t version;
+
+			/// Entrances, numbered side by side, and where each side starts
+			int num_nodes;
+			int side_start[NUM_SIDES + 1];
+			std::vector<CL_Point> nodes;
+
+			/// num_nodes^2 costs between entrances, from*num_nodes + to
+			std::vector<float> edges;
+		} cluster_t;
+
+		/// One cluster's costs with a border of impassable cells, and a
+		/// Dijkstra over them
+		typedef struct
+		{
+			CL_Rect rect;
+			std::vector<float> cells;
+			std::vector<double> dist;
+			std::vector<node_t> queue;
+		} local_t;
+
+		// move cost of a cell, negative if impassable
+		double moveCost( int x, int y ) const;
+
+		// rebuild all borders flagged as changed
+		void repairBorders();
+		void buildBorder( size_t border, bool east );
+
+		void markDirty( int cluster );
+		void markBorder( int border, bool east );
+
+		// entrances along one side of a cluster
+		const std::vector<uint8_t>* sideEntrances( int cluster, int side ) const;
+
+		// recompute the entrances of a cluster and the costs between them
+		void buildCluster( int cluster );
+
+		CL_Rect clusterRect( int cluster ) const;
+		int clusterAt( int x, int y ) const { return (y / cluster_size)*clusters_wide + x / cluster_size; }
+
+		// the paired entrance across the border from an entrance
+		uint32_t across( int cluster, int node ) const;
+
+		// copy a cluster's costs into local
+		void loadCluster( int cluster, local_t &local ) const;
+		size_t localIndex( const local_t &local, int x, int y ) const
+		{
+			return (y - local.rect.top + 1)*(cluster_size + 2) + x - local.rect.left + 1;
+		}
+
+		// Dijkstra over a loaded cluster, forward from or backward to (x,y),
+		// stopping at target if given
+		void localDijkstra( local_t &local, int x, int y, bool forward, const CL_Point *target = NULL ) const;
+
+		// cells from (x,y) to where a backward Dijkstra started, appended to
+		// cells, returning the cost
+		double localDescend( const local_t &local, int x, int y, std::vector<CL_Point> &cells ) const;
+
+		// refine one hop inside a cluster, appending its cells
+		bool refineHop( Context &context, int cluster, int from_node, int to_node,
+				int from_x, int from_y, int to_x, int to_y, double &cost ) const;
+
+		const CostGrid *grid;
+
+		int cluster_size;
+		int clusters_wide, clusters_high;
+
+		std::vector<cluster_t> clusters;
+		std::vector<uint32_t> dirty_clusters;
+
+		/// Entrance offsets along the border east/south of each cluster
+		std::vector< std::vector<uint8_t> > east_borders, south_borders;
+		std::vector<bool> east_dirty, south_dirty;
+		std::vector<uint32_t> dirty_borders;
+
+		/// Largest number of entrances a cluster can have
+		int max_nodes;
+
+		/// Neighbour offsets inside a loaded cluster, in successors order
+		int local_offsets[8];
+
+		/// Storage for building clusters
+		local_t build_local;
+
+		/// Search and context for queries made without a context
+		PathSearch search;
+		Context *context;
+};
+
+class ClusterGraph::Context
+{
+	public:
+		/**
+		 * Context(search)
+		 *
+		 * Storage for queries on a graph, handing short ones to search
+		 */
+		Context( PathSearch *search );
+
+		/**
+		 * Number of abstract nodes expanded by the last query
+		 */
+		size_t getNodesExpanded() const { return nodes_expanded; }
+
+	private:
+		friend class ClusterGraph;
+
+		typedef struct
+		{
+			uint32_t version;
+			double cost;
+			std::vector<CL_Point> cells;
+		} hop_t;
+
+		PathSearch *search;
+
+		/// Abstract search storage, indexed by cluster*max_nodes + entrance
+		uint32_t generation;
+		std::vector<uint32_t> open_stamp, closed_stamp;
+		std::vector<double> costs;
+		std::vector<uint32_t> parents;
+		std::vector<node_t> queue;
+
+		/// Costs from the start to the entrances of its cluster and from
+		/// the goal cluster's entrances to the goal
+		std::vector<double> start_costs, goal_costs;
+
+		/// Refinement scratch space
+		local_t local;
+		std::vector<uint32_t> route;
+		std::vector<CL_Point> refined;
+
+		/// Refined hops between entrances, by cluster and entrance pair
+		std::unordered_map<uint64_t, hop_t> hops;
+
+		size_t nodes_expanded;
+};
+
+#endif
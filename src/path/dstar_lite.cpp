@@ -0,0 +1,447 @@
+/*
+ * File:	dstar_lite.cpp
+ *
+ * Author:	James Letendre
+ *
+ * D* Lite search towards a fixed goal from a moving start
+ */
+
+#include "path/dstar_lite.h"
+#include "path/grid_moves.h"
+#include "map/cost_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// give up after expanding this many nodes in one query
+#define MAX_EXPANSIONS	10000000
+
+// costs are kept in fixed point, so sums along different routes compare
+// exactly and keys left in the queue stay true lower bounds
+#define COST_SCALE	65536.0
+
+#define INF	std::numeric_limits<int64_t>::max()
+
+// state table slots, a power of two, and the marker for an unused one
+#define INITIAL_SLOTS	1024
+#define EMPTY_SLOT		0xffffffffu
+
+DStarLite::DStarLite( const CostGrid *grid )
+	: grid(grid), width(grid->getWidth()), height(grid->getHeight()),
+	goal_x(-1), goal_y(-1), start_x(-1), start_y(-1), h_scale(1), km(0), nodes_expanded(0)
+{
+	reset( -1, -1 );
+}
+
+/*
+ * Forget everything and plan towards a new goal
+ */
+void DStarLite::reset( int goal_x, int goal_y )
+{
+	this->goal_x = goal_x;
+	this->goal_y = goal_y;
+
+	// seeded by the first query, once the start is known
+	start_x = start_y = -1;
+
+	state_keys.assign( INITIAL_SLOTS, EMPTY_SLOT );
+	state_values.resize( INITIAL_SLOTS );
+	state_count = 0;
+	state_shift = 32 - 10;
+
+	queue.clear();
+	km = 0;
+	h_scale = grid->getMinCost();
+
+	// octile distance in the same fixed point as the moves, a norm as long as
+	// a diagonal is no cheaper than a straight step and no dearer than two
+	h_straight = llround( h_scale * COST_SCALE );
+	h_diagonal = llround( h_scale * M_SQRT2 * COST_SCALE );
+}
+
+bool DStarLite::keyLess( const key_t &a, const key_t &b )
+{
+	return a.k1 < b.k1 || ( a.k1 == b.k1 && a.k2 < b.k2 );
+}
+
+/*
+ * Ordering for the open list, smallest key first
+ */
+bool DStarLite::entryCompare( const entry_t &a, const entry_t &b )
+{
+	return keyLess( b.key, a.key );
+}
+
+const DStarLite::state_t* DStarLite::findState( uint32_t index ) const
+{
+	const size_t mask = state_keys.size() - 1;
+
+	for( size_t slot = (uint32_t)(index * 2654435761u) >> state_shift; ; slot = (slot + 1) & mask )
+	{
+		if( state_keys[slot] == index ) return &state_values[slot];
+		if( state_keys[slot] == EMPTY_SLOT ) return NULL;
+	}
+}
+
+DStarLite::state_t* DStarLite::findState( uint32_t index )
+{
+	return const_cast<state_t*>( static_cast<const DStarLite*>(this)->findState(index) );
+}
+
+/*
+ * Add an unreached cell, or find it if it is already there
+ */
+DStarLite::state_t* DStarLite::insertState( uint32_t index )
+{
+	// keep the table at most half full
+	if( 2*(state_count + 1) > state_keys.size() ) growStates();
+
+	const size_t mask = state_keys.size() - 1;
+
+	size_t slot = (uint32_t)(index * 2654435761u) >> state_shift;
+	while( state_keys[slot] != EMPTY_SLOT )
+	{
+		if( state_keys[slot] == index ) return &state_values[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	state_count++;
+	state_keys[slot] = index;
+	state_values[slot] = (state_t){INF, INF, {0, 0}, false};
+
+	return &state_values[slot];
+}
+
+void DStarLite::growStates()
+{
+	std::vector<uint32_t> old_keys( state_keys.size()*2, EMPTY_SLOT );
+	std::vector<state_t> old_values( state_values.size()*2 );
+
+	old_keys.swap( state_keys );
+	old_values.swap( state_values );
+	state_shift--;
+
+	const size_t mask = state_keys.size() - 1;
+	for( size_t i = 0; i < old_keys.size(); i++ )
+	{
+		if( old_keys[i] == EMPTY_SLOT ) continue;
+
+		size_t slot = (uint32_t)(old_keys[i] * 2654435761u) >> state_shift;
+		while( state_keys[slot] != EMPTY_SLOT ) slot = (slot + 1) & mask;
+
+		state_keys[slot] = old_keys[i];
+		state_values[slot] = old_values[i];
+	}
+}
+
+int64_t DStarLite::getG( uint32_t index ) const
+{
+	const state_t *s = findState( index );
+	return s ? s->g : INF;
+}
+
+int64_t DStarLite::getRhs( uint32_t index ) const
+{
+	const state_t *s = findState( index );
+	return s ? s->rhs : INF;
+}
+
+int64_t DStarLite::moveCost( int x, int y, int move ) const
+{
+	const double c = grid->get(x, y);
+	return c < 0 ? INF : llround( successors[move].weight * c * COST_SCALE );
+}
+
+/*
+ * Sum that stays infinite
+ */
+static inline int64_t add( int64_t a, int64_t b )
+{
+	return ( a == INF || b == INF ) ? INF : a + b;
+}
+
+int64_t DStarLite::heuristic( int x, int y ) const
+{
+	const int dx = abs(x - start_x), dy = abs(y - start_y);
+	const int diagonal = std::min( dx, dy ), straight = std::max( dx, dy ) - diagonal;
+
+	return straight*h_straight + diagonal*h_diagonal;
+}
+
+DStarLite::key_t DStarLite::calculateKey( uint32_t index, int64_t g, int64_t rhs ) const
+{
+	const int64_t m = std::min( g, rhs );
+
+	return (key_t){ add( add( m, heuristic(index % width, index / width) ), km ), m };
+}
+
+/*
+ * Cheapest way to the goal through any neighbour
+ */
+int64_t DStarLite::bestRhs( int x, int y ) const
+{
+	if( grid->get(x, y) < 0 ) return INF;
+
+	int64_t best = INF;
+	for( int i = 0; i < NUM_SUCCESSORS; i++ )
+	{
+		const int nx = x + successors[i].dx;
+		const int ny = y + successors[i].dy;
+
+		if( nx < 0 || (size_t)nx >= width || ny < 0 || (size_t)ny >= height ) continue;
+
+		best = std::min( best, add( moveCost(x, y, i), getG(ny*width + nx) ) );
+	}
+	return best;
+}
+
+/*
+ * Queue an inconsistent cell, drop a consistent one
+ */
+void DStarLite::updateVertex( uint32_t index )
+{
+	state_t *s = findState( index );
+	if( !s ) return;
+
+	if( s->g != s->rhs )
+	{
+		s->key = calculateKey( index, s->g, s->rhs );
+		s->open = true;
+
+		queue.push_back( (entry_t){s->key, index} );
+		std::push_heap( queue.begin(), queue.end(), entryCompare );
+	}
+	else
+	{
+		s->open = false;
+	}
+}
+
+/*
+ * Entries are left in the heap when a cell is requeued or closed, skip
+ * them here
+ */
+bool DStarLite::cleanTop()
+{
+	while( !queue.empty() )
+	{
+		const entry_t &top = queue.front();
+
+		const state_t *s = findState( top.index );
+		if( s && s->open && s->key.k1 == top.key.k1 && s->key.k2 == top.key.k2 )
+			return true;
+
+		std::pop_heap( queue.begin(), queue.end(), entryCompare );
+		queue.pop_back();
+	}
+	return false;
+}
+
+/*
+ * A cell's move cost changed, only its own outgoing moves are affected
+ */
+void DStarLite::cellChanged( size_t x, size_t y )
+{
+	if( x >= width || y >= height ) return;
+	if( (int)x == goal_x && (int)y == goal_y ) return;
+
+	const int64_t rhs = bestRhs( x, y );
+	const uint32_t index = y*width + x;
+
+	state_t *s = findState( index );
+	if( !s )
+	{
+		// unseen and still unreachable
+		if( rhs == INF ) return;
+
+		s = insertState( index );
+	}
+
+	s->rhs = rhs;
+	updateVertex( index );
+}
+
+bool DStarLite::computeShortestPath()
+{
+	const uint32_t start = start_y*width + start_x;
+	const uint32_t goal = goal_y*width + goal_x;
+
+	nodes_expanded = 0;
+
+	while( cleanTop() )
+	{
+		const int64_t start_g = getG( start ), start_rhs = getRhs( start );
+		if( !keyLess( queue.front().key, calculateKey(start, start_g, start_rhs) ) && start_g == start_rhs )
+			break;
+
+		if( nodes_expanded++ > MAX_EXPANSIONS ) return false;
+
+		const entry_t top = queue.front();
+		std::pop_heap( queue.begin(), queue.end(), entryCompare );
+		queue.pop_back();
+
+		// u is only good until the next insert
+		state_t &u = *findState( top.index );
+		const int ux = top.index % width;
+		const int uy = top.index / width;
+
+		// start has moved since this was queued
+		const key_t new_key = calculateKey( top.index, u.g, u.rhs );
+		if( keyLess( top.key, new_key ) )
+		{
+			u.key = new_key;
+			queue.push_back( (entry_t){new_key, top.index} );
+			std::push_heap( queue.begin(), queue.end(), entryCompare );
+			continue;
+		}
+
+		if( u.g > u.rhs )
+		{
+			// cheaper than before, neighbours may now go through here
+			u.g = u.rhs;
+			u.open = false;
+
+			const int64_t g = u.g;
+			for( int i = 0; i < NUM_SUCCESSORS; i++ )
+			{
+				const int nx = ux + successors[i].dx;
+				const int ny = uy + successors[i].dy;
+
+				if( nx < 0 || (size_t)nx >= width || ny < 0 || (size_t)ny >= height ) continue;
+
+				const uint32_t n = ny*width + nx;
+				if( n == goal ) continue;
+
+				// neighbours step back the opposite way
+				const int64_t through = add( moveCost(nx, ny, i), g );
+				if( through == INF ) continue;
+
+				state_t *s = insertState( n );
+				if( through < s->rhs )
+				{
+					s->rhs = through;
+					updateVertex( n );
+				}
+			}
+		}
+		else
+		{
+			// dearer than before, anything that went through here looks again
+			const int64_t g_old = u.g;
+			u.g = INF;
+
+			if( top.index != goal )
+				u.rhs = bestRhs( ux, uy );
+			updateVertex( top.index );
+
+			for( int i = 0; i < NUM_SUCCESSORS; i++ )
+			{
+				const int nx = ux + successors[i].dx;
+				const int ny = uy + successors[i].dy;
+
+				if( nx < 0 || (size_t)nx >= width || ny < 0 || (size_t)ny >= height ) continue;
+
+				const uint32_t n = ny*width + nx;
+				if( n == goal ) continue;
+
+				state_t *s = findState( n );
+				if( !s ) continue;
+
+				if( s->rhs == add( moveCost(nx, ny, i), g_old ) )
+				{
+					s->rhs = bestRhs( nx, ny );
+					updateVertex( n );
+				}
+			}
+		}
+	}
+
+	return getG( start ) != INF;
+}
+
+/*
+ * Path from start to the goal, repairing the search first
+ */
+bool DStarLite::findPath( int start_x, int start_y, std::vector<CL_Point> &path, double *cost )
+{
+	if( goal_x < 0 || (size_t)goal_x >= width || goal_y < 0 || (size_t)goal_y >= height ||
+			start_x < 0 || (size_t)start_x >= width || start_y < 0 || (size_t)start_y >= height )
+	{
+		if (cost) *cost = std::numeric_limits<double>::infinity();
+		return false;
+	}
+
+	// a cheaper cell appeared, the old heuristic could overestimate
+	if( grid->getMinCost() < h_scale )
+		reset( goal_x, goal_y );
+
+	if( this->start_x < 0 )
+	{
+		this->start_x = start_x;
+		this->start_y = start_y;
+
+		const uint32_t goal = goal_y*width + goal_x;
+		insertState( goal )->rhs = 0;
+		updateVertex( goal );
+	}
+	else if( start_x != this->start_x || start_y != this->start_y )
+	{
+		// keys already queued stay lower bounds if km grows by the move
+		const int64_t moved = heuristic( start_x, start_y );
+		this->start_x = start_x;
+		this->start_y = start_y;
+		km += moved;
+	}
+
+	if( !computeShortestPath() )
+	{
+		if (cost) *cost = std::numeric_limits<double>::infinity();
+		return false;
+	}
+
+	// walk downhill to the goal, then flip so the next step is at the back
+	std::vector<CL_Point> route;
+	double total = 0;
+
+	int x = start_x, y = start_y;
+	while( x != goal_x || y != goal_y )
+	{
+		int64_t best = INF;
+		int best_move = 0;
+
+		for( int i = 0; i < NUM_SUCCESSORS; i++ )
+		{
+			const int nx = x + successors[i].dx;
+			const int ny = y + successors[i].dy;
+
+			if( nx < 0 || (size_t)nx >= width || ny < 0 || (size_t)ny >= height ) continue;
+
+			const int64_t through = add( moveCost(x, y, i), getG(ny*width + nx) );
+			if( through < best )
+			{
+				best = through;
+				best_move = i;
+			}
+		}
+
+		if( best == INF || route.size() > width*height )
+		{
+			if (cost) *cost = std::numeric_limits<double>::infinity();
+			return false;
+		}
+
+		// report the cost the same way the other searches add it up
+		total += successors[best_move].weight * grid->get(x, y);
+
+		x += successors[best_move].dx;
+		y += successors[best_move].dy;
+		route.push_back( CL_Point(x, y) );
+	}
+
+	std::reverse( route.begin(), route.end() );
+	path.swap( route );
+
+	if (cost) *cost = total;
+	return true;
+}
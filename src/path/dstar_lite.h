@@ -0,0 +1,139 @@
+/*
+ * File:	dstar_lite.h
+ *
+ * Author:	James Letendre
+ *
+ * D* Lite search towards a fixed goal from a moving start. The search
+ * state is kept between queries, so after a few cells change cost only
+ * the part of the search they affect is redone.
+ */
+#ifndef DSTAR_LITE_H
+#define DSTAR_LITE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <ClanLib/core.h>
+
+class CostGrid;
+
+class DStarLite
+{
+	public:
+		/**
+		 * DStarLite(grid)
+		 *
+		 * Plan over grid, which may change between queries as long as every
+		 * changed cell is reported through cellChanged
+		 */
+		DStarLite( const CostGrid *grid );
+
+		/**
+		 * Forget everything and plan towards a new goal
+		 */
+		void reset( int goal_x, int goal_y );
+
+		int getGoalX() const { return goal_x; }
+		int getGoalY() const { return goal_y; }
+
+		/**
+		 * A cell's move cost changed since the last query
+		 */
+		void cellChanged( size_t x, size_t y );
+
+		/**
+		 * Path from start to the goal, same conventions as
+		 * PathSearch::findPath. Only the part of the search invalidated by
+		 * changes or a moved start is redone.
+		 */
+		bool findPath( int start_x, int start_y, std::vector<CL_Point> &path, double *cost = NULL );
+
+		/**
+		 * Nodes expanded by the last query
+		 */
+		size_t getNodesExpanded() const { return nodes_expanded; }
+
+		/**
+		 * Number of cells the search holds state for
+		 */
+		size_t getStateCount() const { return state_count; }
+
+	private:
+		/// Costs and keys are fixed point, see COST_SCALE
+		typedef struct
+		{
+			int64_t k1, k2;
+		} key_t;
+
+		typedef struct
+		{
+			int64_t g, rhs;
+
+			/// Key it is queued under, if open
+			key_t key;
+			bool open;
+		} state_t;
+
+		typedef struct
+		{
+			key_t key;
+			uint32_t index;
+		} entry_t;
+
+		static bool keyLess( const key_t &a, const key_t &b );
+		static bool entryCompare( const entry_t &a, const entry_t &b );
+
+		// open addressed table of touched cells, pointers stay good until
+		// the next insert
+		state_t* findState( uint32_t index );
+		const state_t* findState( uint32_t index ) const;
+		state_t* insertState( uint32_t index );
+		void growStates();
+
+		int64_t getG( uint32_t index ) const;
+		int64_t getRhs( uint32_t index ) const;
+
+		// cost of leaving the cell by one of the successors, infinite if
+		// impassable
+		int64_t moveCost( int x, int y, int move ) const;
+
+		// estimate of the cost from the start to the cell
+		int64_t heuristic( int x, int y ) const;
+
+		key_t calculateKey( uint32_t index, int64_t g, int64_t rhs ) const;
+
+		// best rhs over the cell's neighbours
+		int64_t bestRhs( int x, int y ) const;
+
+		// queue or dequeue after g or rhs changed
+		void updateVertex( uint32_t index );
+
+		// drop stale queue entries, false if the queue is empty
+		bool cleanTop();
+
+		bool computeShortestPath();
+
+		const CostGrid *grid;
+		size_t width, height;
+
+		int goal_x, goal_y;
+		int start_x, start_y;
+
+		/// Heuristic scale, its fixed point steps, and accumulated start
+		/// movement
+		double h_scale;
+		int64_t h_straight, h_diagonal;
+		int64_t km;
+
+		/// Cell index per slot, EMPTY_SLOT if unused
+		std::vector<uint32_t> state_keys;
+		std::vector<state_t> state_values;
+		size_t state_count;
+		int state_shift;
+
+		std::vector<entry_t> queue;
+
+		size_t nodes_expanded;
+};
+
+#endif
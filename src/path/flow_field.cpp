@@ -0,0 +1,325 @@
+/*
+ * File:	flow_field.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Distance fields towards shared destinations
+ */
+
+#include "path/flow_field.h"
+#include "path/grid_moves.h"
+#include "map/map.h"
+#include "map/cost_grid.h"
+
+#include <algorithm>
+#include <limits>
+
+#define INF	std::numeric_limits<float>::infinity()
+
+FlowField::FlowField( Map *map )
+	: last_used(0), map(map), width(map->getWidth()), height(map->getHeight()),
+	valid(false), goal_x(-1), goal_y(-1)
+{
+	chunks_wide = (width + FLOW_CHUNK_SIZE - 1) >> FLOW_CHUNK_SHIFT;
+	chunks_high = (height + FLOW_CHUNK_SIZE - 1) >> FLOW_CHUNK_SHIFT;
+	chunks.assign( chunks_wide*chunks_high, NULL );
+}
+
+FlowField::~FlowField()
+{
+	release();
+}
+
+/*
+ * Chunk holding (x,y), nothing in it touched yet if it is new
+ */
+FlowField::chunk_t* FlowField::editChunk( size_t x, size_t y )
+{
+	const size_t index = chunkIndex(x, y);
+	if( !chunks[index] )
+	{
+		chunks[index] = new chunk_t();
+		used.push_back( index );
+	}
+
+	return chunks[index];
+}
+
+void FlowField::release()
+{
+	for( uint32_t index : used )
+	{
+		delete chunks[index];
+		chunks[index] = NULL;
+	}
+	used.clear();
+}
+
+void FlowField::invalidate()
+{
+	valid = false;
+	queue.clear();
+	release();
+}
+
+/*
+ * Start a new field towards the goal
+ */
+void FlowField::reset( int goal_x, int goal_y )
+{
+	this->goal_x = goal_x;
+	this->goal_y = goal_y;
+
+	release();
+	queue.clear();
+	valid = goal_x >= 0 && (size_t)goal_x < width && goal_y >= 0 && (size_t)goal_y < height;
+	if( !valid ) return;
+
+	chunk_t *chunk = editChunk( goal_x, goal_y );
+	bounds = CL_Rect( goal_x, goal_y, goal_x + 1, goal_y + 1 );
+	touch( chunk, goal_x, goal_y );
+	chunk->distance[localIndex(goal_x, goal_y)] = 0;
+	queue.push_back( (node_t){(uint32_t)(goal_y*width + goal_x), 0} );
+}
+
+void FlowField::touch( chunk_t *chunk, int x, int y )
+{
+	chunk->state[localIndex(x, y)] = TOUCHED;
+
+	bounds.left = std::min( bounds.left, x );
+	bounds.top = std::min( bounds.top, y );
+	bounds.right = std::max( bounds.right, x + 1 );
+	bounds.bottom = std::max( bounds.bottom, y + 1 );
+}
+
+/*
+ * Run the backward Dijkstra until (x,y) is settled
+ */
+bool FlowField::extendTo( int x, int y )
+{
+	if( !valid || x < 0 || (size_t)x >= width || y < 0 || (size_t)y >= height ) return false;
+
+	const CostGrid &grid( map->getCostGrid() );
+
+	while( !settled(x, y) )
+	{
+		if( queue.empty() ) return false;
+
+		std::pop_heap( queue.begin(), queue.end(), best_weight_compare<node_t> );
+		node_t head = queue.back();
+		queue.pop_back();
+
+		const int head_x = head.index % width;
+		const int head_y = head.index / width;
+
+		chunk_t *head_chunk = chunkAt( head_x, head_y );
+		const size_t head_local = localIndex( head_x, head_y );
+		if( (head_chunk->state[head_local] & SETTLED) || head.weight > head_chunk->distance[head_local] ) continue;
+		head_chunk->state[head_local] |= SETTLED;
+
+		for( int i = 0; i < NUM_SUCCESSORS; i++ )
+		{
+			const int child_x = head_x + successors[i].dx;
+			const int child_y = head_y + successors[i].dy;
+
+			if( child_x < 0 || (size_t)child_x >= width || child_y < 0 || (size_t)child_y >= height )
+				continue;
+
+			chunk_t *chunk = chunkAt( child_x, child_y );
+			const size_t local = localIndex( child_x, child_y );
+			if( chunk && (chunk->state[local] & SETTLED) ) continue;
+
+			const double p = grid.get(child_x, child_y);
+			if( p < 0 )
+			{
+				// remember we saw it, opening it up would change the field
+				if( !chunk ) chunk = editChunk( child_x, child_y );
+				touch( chunk, child_x, child_y );
+				chunk->distance[local] = INF;
+				continue;
+			}
+
+			// moving out of the child costs the child
+			const float child_cost = head.weight + successors[i].weight * p;
+			if( chunk && chunk->state[local] == TOUCHED && chunk->distance[local] <= child_cost ) continue;
+
+			if( !chunk ) chunk = editChunk( child_x, child_y );
+			touch( chunk, child_x, child_y );
+			chunk->distance[local] = child_cost;
+			chunk->next_step[local] = i;
+
+			queue.push_back( (node_t){(uint32_t)(child_y*width + child_x), child_cost} );
+			std::push_heap( queue.begin(), queue.end(), best_weight_compare<node_t> );
+		}
+	}
+
+	return chunkAt(x, y)->distance[localIndex(x, y)] != INF;
+}
+
+/*
+ * Follow the next steps from (x,y) to the goal
+ */
+bool FlowField::getPath( int x, int y, std::vector<CL_Point> &path, double *cost )
+{
+	if( !valid || x < 0 || (size_t)x >= width || y < 0 || (size_t)y >= height ) return false;
+
+	if( !settled(x, y) ) return false;
+
+	const float distance = chunkAt(x, y)->distance[localIndex(x, y)];
+	if( distance == INF ) return false;
+
+	if (cost) *cost = distance;
+
+	path.clear();
+	while( x != goal_x || y != goal_y )
+	{
+		// the stored successor points from the parent to us, so step back along it
+		const int step = chunkAt(x, y)->next_step[localIndex(x, y)];
+		x -= successors[step].dx;
+		y -= successors[step].dy;
+
+		path.push_back( CL_Point(x, y) );
+	}
+	std::reverse( path.begin(), path.end() );
+
+	return true;
+}
+
+/*
+ * Only the part of rect inside the field's bounds needs looking at
+ */
+bool FlowField::touches( const CL_Rect &rect ) const
+{
+	if( !valid ) return false;
+
+	const int left = std::max( rect.left, bounds.left ), top = std::max( rect.top, bounds.top );
+	const int right = std::min( rect.right, bounds.right ), bottom = std::min( rect.bottom, bounds.bottom );
+
+	for( int y = top; y < bottom; y++ )
+	{
+		for( int x = left; x < right; x++ )
+		{
+			const chunk_t *chunk = chunkAt(x, y);
+			if( chunk && chunk->state[localIndex(x, y)] ) return true;
+		}
+	}
+
+	return false;
+}
+
+FlowFieldCache::FlowFieldCache( Map *map, size_t capacity, size_t max_memory )
+	: map(map), capacity(std::max((size_t)1, capacity)), max_memory(max_memory), clock(0),
+	hits(0), misses(0), invalidations(0), evictions(0)
+{
+}
+
+FlowFieldCache::~FlowFieldCache()
+{
+	for( FlowField *f : fields )
+	{
+		delete f;
+	}
+}
+
+/*
+ * Path from start to goal using the goal's field
+ */
+bool FlowFieldCache::findPath( int start_x, int start_y, int goal_x, int goal_y,
+		std::vector<CL_Point> &path, double *cost )
+{
+	FlowField *field = NULL;
+
+	for( FlowField *f : fields )
+	{
+		if( f->isValid() && f->getGoalX() == goal_x && f->getGoalY() == goal_y )
+		{
+			field = f;
+			break;
+		}
+	}
+
+	if( field )
+	{
+		hits++;
+	}
+	else
+	{
+		misses++;
+
+		// reuse a dropped field, the least recently used one, or make a new one
+		for( FlowField *f : fields )
+		{
+			if( !field || !f->isValid() || ( field->isValid() && f->last_used < field->last_used ) )
+				field = f;
+		}
+
+		if( fields.size() < capacity && ( !field || field->isValid() ) )
+		{
+			field = new FlowField( map );
+			fields.push_back( field );
+		}
+
+		field->reset( goal_x, goal_y );
+	}
+
+	field->last_used = ++clock;
+
+	const bool reached = field->extendTo( start_x, start_y );
+	trim( field );
+
+	if( !reached )
+	{
+		if (cost) *cost = std::numeric_limits<double>::infinity();
+		return false;
+	}
+
+	return field->getPath( start_x, start_y, path, cost );
+}
+
+/*
+ * Drop every field that reached a changed cell
+ */
+void FlowFieldCache::regionChanged( const CL_Rect &rect )
+{
+	for( FlowField *f : fields )
+	{
+		if( f->touches(rect) )
+		{
+			f->invalidate();
+			invalidations++;
+		}
+	}
+}
+
+size_t FlowFieldCache::getMemory() const
+{
+	size_t memory = 0;
+	for( const FlowField *f : fields )
+	{
+		memory += f->getMemory();
+	}
+	return memory;
+}
+
+/*
+ * Drop the least recently used fields until the rest fit
+ */
+void FlowFieldCache::trim( const FlowField *keep )
+{
+	size_t memory = getMemory();
+
+	while( memory > max_memory )
+	{
+		FlowField *oldest = NULL;
+		for( FlowField *f : fields )
+		{
+			if( f != keep && f->getMemory() > 0 && ( !oldest || f->last_used < oldest->last_used ) )
+				oldest = f;
+		}
+		if( !oldest ) return;
+
+		memory -= oldest->getMemory();
+		oldest->invalidate();
+		evictions++;
+	}
+}
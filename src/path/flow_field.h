@@ -0,0 +1,181 @@
+/*
+ * File:	flow_field.h
+ *
+ * Author:	James Letendre
+ *
+ * Distance fields towards shared destinations. Every Mover heading for the
+ * same cell reads one backward Dijkstra instead of running its own search.
+ *
+ * A field only stores the chunks of the map its search has reached, so a
+ * field towards a nearby goal costs a few kB however large the map is.
+ */
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <ClanLib/core.h>
+
+// flow fields are stored in square chunks of FLOW_CHUNK_SIZE cells a side
+#define FLOW_CHUNK_SHIFT	5
+#define FLOW_CHUNK_SIZE		(1 << FLOW_CHUNK_SHIFT)
+#define FLOW_CHUNK_MASK		(FLOW_CHUNK_SIZE - 1)
+
+class Map;
+
+class FlowField
+{
+	public:
+		FlowField( Map *map );
+		~FlowField();
+
+		/**
+		 * Start a new field towards (goal_x, goal_y), nothing is searched yet
+		 */
+		void reset( int goal_x, int goal_y );
+
+		/**
+		 * Grow the field until (x,y) has its final distance. Returns false if
+		 * the cell can't reach the goal.
+		 */
+		bool extendTo( int x, int y );
+
+		/**
+		 * Follow the field from (x,y) to the goal, same conventions as
+		 * PathSearch::findPath. Call extendTo first.
+		 */
+		bool getPath( int x, int y, std::vector<CL_Point> &path, double *cost = NULL );
+
+		/**
+		 * Did the field look at any cell inside rect? Changes to cells it
+		 * never reached can't change any distance it has settled.
+		 */
+		bool touches( const CL_Rect &rect ) const;
+
+		bool isValid() const { return valid; }
+
+		/**
+		 * Drop the field and the chunks it holds
+		 */
+		void invalidate();
+
+		/**
+		 * Bytes held by the field's chunks
+		 */
+		size_t getMemory() const { return used.size()*sizeof(chunk_t); }
+
+		int getGoalX() const { return goal_x; }
+		int getGoalY() const { return goal_y; }
+
+		/// Last time this field was used, for LRU eviction
+		uint64_t last_used;
+
+	private:
+		typedef struct
+		{
+			uint32_t index;
+			float weight;
+		} node_t;
+
+		enum { TOUCHED = 1, SETTLED = 2 };
+
+		typedef struct
+		{
+			/// TOUCHED once looked at, | SETTLED once the distance is final
+			uint8_t state[FLOW_CHUNK_SIZE*FLOW_CHUNK_SIZE];
+			float distance[FLOW_CHUNK_SIZE*FLOW_CHUNK_SIZE];
+
+			/// Direction of the next step towards the goal
+			uint8_t next_step[FLOW_CHUNK_SIZE*FLOW_CHUNK_SIZE];
+		} chunk_t;
+
+		static size_t localIndex( size_t x, size_t y ) { return ((y & FLOW_CHUNK_MASK) << FLOW_CHUNK_SHIFT) + (x & FLOW_CHUNK_MASK); }
+		size_t chunkIndex( size_t x, size_t y ) const { return (y >> FLOW_CHUNK_SHIFT)*chunks_wide + (x >> FLOW_CHUNK_SHIFT); }
+
+		// chunk holding (x,y), NULL if the search never reached it
+		chunk_t* chunkAt( size_t x, size_t y ) const { return chunks[chunkIndex(x, y)]; }
+
+		// chunk holding (x,y), allocating it on first use
+		chunk_t* editChunk( size_t x, size_t y );
+
+		bool settled( size_t x, size_t y ) const
+		{
+			const chunk_t *chunk = chunkAt(x, y);
+			return chunk && (chunk->state[localIndex(x, y)] & SETTLED);
+		}
+
+		// mark a cell looked at, growing bounds over it
+		void touch( chunk_t *chunk, int x, int y );
+
+		// free every chunk
+		void release();
+
+		Map *map;
+		size_t width, height;
+		size_t chunks_wide, chunks_high;
+
+		bool valid;
+		int goal_x, goal_y;
+
+		/// Chunks reached by the search, NULL elsewhere, and the indices of
+		/// those allocated
+		std::vector<chunk_t*> chunks;
+		std::vector<uint32_t> used;
+
+		/// Rectangle bounding the cells looked at
+		CL_Rect bounds;
+
+		std::vector<node_t> queue;
+};
+
+class FlowFieldCache
+{
+	public:
+		/**
+		 * FlowFieldCache(map, capacity, max_memory)
+		 *
+		 * Keep up to capacity fields holding up to max_memory bytes between
+		 * them, the least recently used is dropped first. The field in use
+		 * may grow past max_memory on its own.
+		 */
+		FlowFieldCache( Map *map, size_t capacity = 8, size_t max_memory = 64 << 20 );
+		~FlowFieldCache();
+
+		/**
+		 * Path from start to goal using the goal's field, building it if needed
+		 */
+		bool findPath( int start_x, int start_y, int goal_x, int goal_y,
+				std::vector<CL_Point> &path, double *cost = NULL );
+
+		/**
+		 * Drop every field that reached a cell inside rect
+		 */
+		void regionChanged( const CL_Rect &rect );
+
+		size_t getHits() const { return hits; }
+		size_t getMisses() const { return misses; }
+		size_t getInvalidations() const { return invalidations; }
+		size_t getEvictions() const { return evictions; }
+
+		/**
+		 * Bytes held by all fields
+		 */
+		size_t getMemory() const;
+
+	private:
+		// drop the least recently used fields other than keep until the
+		// rest fit in max_memory
+		void trim( const FlowField *keep );
+
+		Map *map;
+
+		size_t capacity, max_memory;
+		std::vector<FlowField*> fields;
+
+		uint64_t clock;
+
+		size_t hits, misses, invalidations, evictions;
+};
+
+#endif
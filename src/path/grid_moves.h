@@ -0,0 +1,53 @@
+/*
+ * File:	grid_moves.h
+ *
+ * Author:	James Letendre
+ *
+ * Moves and distance estimates shared by the path searches
+ */
+#ifndef GRID_MOVES_H
+#define GRID_MOVES_H
+
+#include <cmath>
+#include <stdlib.h>
+
+//
+// List of possible successors that we would like to consider
+//
+#define NUM_SUCCESSORS 8
+static const struct
+{
+	int dx, dy;
+	double weight;
+} successors[NUM_SUCCESSORS] = {
+	{ 1,  0, 1},
+	{-1,  0, 1},
+	{ 0,  1, 1},
+	{ 0, -1, 1},
+	{ 1,  1, M_SQRT2},
+	{ 1, -1, M_SQRT2},
+	{-1,  1, M_SQRT2},
+	{-1, -1, M_SQRT2},
+};
+
+/*
+ * Length of the shortest 8-connected walk between two cells
+ */
+static inline double octile_distance( int dx, int dy )
+{
+	dx = abs(dx);
+	dy = abs(dy);
+	return dx > dy ? dx + (M_SQRT2 - 1)*dy : dy + (M_SQRT2 - 1)*dx;
+}
+
+/*
+ * Ordering for open lists kept with std::push_heap/pop_heap, lowest weight
+ * first
+ */
+template<typename T>
+static bool best_weight_compare( const T &a, const T &b )
+{
+	return a.weight > b.weight;
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * File:	path_cache.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Finished paths kept by (start, goal)
+ */
+
+#include "path/path_cache.h"
+
+#include <algorithm>
+
+PathCache::PathCache( size_t w, size_t h, size_t capacity, int region_size )
+	: width(w), height(h), capacity(std::max((size_t)1, capacity)),
+	region_size(std::max(1, region_size)), hits(0), misses(0), invalidations(0),
+	evictions(0), memory(0)
+{
+	regions_wide = (width + this->region_size - 1) / this->region_size;
+	const size_t regions_high = (height + this->region_size - 1) / this->region_size;
+
+	region_versions.assign( regions_wide*regions_high, 0 );
+}
+
+uint64_t PathCache::makeKey( int start_x, int start_y, int goal_x, int goal_y ) const
+{
+	const uint64_t start = (uint64_t)start_y*width + start_x;
+	const uint64_t goal = (uint64_t)goal_y*width + goal_x;
+
+	return start*width*height + goal;
+}
+
+uint32_t PathCache::regionOf( int x, int y ) const
+{
+	return (y / region_size)*regions_wide + x / region_size;
+}
+
+bool PathCache::isCurrent( const entry_t &entry ) const
+{
+	for( uint32_t r : entry.regions )
+	{
+		if( region_versions[r] > entry.version ) return false;
+	}
+	return true;
+}
+
+size_t PathCache::entrySize( const entry_t &entry ) const
+{
+	// list node, index slot, and the two arrays
+	return sizeof(entry_t) + 2*sizeof(void*) + sizeof(uint64_t) + 2*sizeof(void*)
+		+ entry.path.capacity()*sizeof(CL_Point) + entry.regions.capacity()*sizeof(uint32_t);
+}
+
+void PathCache::erase( entry_list::iterator iter )
+{
+	memory -= entrySize( *iter );
+	index.erase( iter->key );
+	entries.erase( iter );
+}
+
+/*
+ * Copy out a cached path that is still good
+ */
+bool PathCache::lookup( int start_x, int start_y, int goal_x, int goal_y,
+		std::vector<CL_Point> &path, double *cost )
+{
+	if( start_x < 0 || (size_t)start_x >= width || start_y < 0 || (size_t)start_y >= height ||
+			goal_x < 0 || (size_t)goal_x >= width || goal_y < 0 || (size_t)goal_y >= height )
+	{
+		misses++;
+		return false;
+	}
+
+	auto found = index.find( makeKey(start_x, start_y, goal_x, goal_y) );
+	if( found == index.end() )
+	{
+		misses++;
+		return false;
+	}
+
+	entry_list::iterator iter = found->second;
+	if( !isCurrent( *iter ) )
+	{
+		erase( iter );
+		invalidations++;
+		misses++;
+		return false;
+	}
+
+	// most recently used moves to the front
+	entries.splice( entries.begin(), entries, iter );
+
+	path = iter->path;
+	if (cost) *cost = iter->cost;
+
+	hits++;
+	return true;
+}
+
+/*
+ * Remember a searched path
+ */
+void PathCache::store( int start_x, int start_y, int goal_x, int goal_y,
+		const std::vector<CL_Point> &path, double cost, uint64_t version )
+{
+	if( start_x < 0 || (size_t)start_x >= width || start_y < 0 || (size_t)start_y >= height ||
+			goal_x < 0 || (size_t)goal_x >= width || goal_y < 0 || (size_t)goal_y >= height )
+		return;
+
+	const uint64_t key = makeKey( start_x, start_y, goal_x, goal_y );
+
+	auto found = index.find( key );
+	if( found != index.end() )
+	{
+		// keep whichever was searched against newer costs
+		if( found->second->version >= version ) return;
+		erase( found->second );
+	}
+
+	entries.push_front( entry_t() );
+	entry_t &entry = entries.front();
+
+	entry.key = key;
+	entry.version = version;
+	entry.cost = cost;
+	entry.path = path;
+
+	// every cell the path leaves, which is where its cost comes from
+	entry.regions.push_back( regionOf(start_x, start_y) );
+	for( const CL_Point &p : path )
+	{
+		const uint32_t r = regionOf( p.x, p.y );
+		if( r != entry.regions.back() ) entry.regions.push_back( r );
+	}
+	std::sort( entry.regions.begin(), entry.regions.end() );
+	entry.regions.erase( std::unique(entry.regions.begin(), entry.regions.end()), entry.regions.end() );
+
+	// a region may have changed between the search and now
+	if( !isCurrent( entry ) )
+	{
+		entries.pop_front();
+		return;
+	}
+
+	index[key] = entries.begin();
+	memory += entrySize( entry );
+
+	while( entries.size() > capacity )
+	{
+		erase( --entries.end() );
+		evictions++;
+	}
+}
+
+/*
+ * Bring the regions under rect up to version
+ */
+void PathCache::regionChanged( const CL_Rect &rect, uint64_t version )
+{
+	const int left = std::max( rect.left, 0 ), top = std::max( rect.top, 0 );
+	const int right = std::min( rect.right, (int)width ), bottom = std::min( rect.bottom, (int)height );
+	if( left >= right || top >= bottom ) return;
+
+	for( int ry = top / region_size; ry <= (bottom - 1) / region_size; ry++ )
+	{
+		for( int rx = left / region_size; rx <= (right - 1) / region_size; rx++ )
+		{
+			uint64_t &v = region_versions[ ry*regions_wide + rx ];
+			v = std::max( v, version );
+		}
+	}
+}
+
+void PathCache::clear()
+{
+	entries.clear();
+	index.clear();
+	memory = 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * File:	path_cache.h
+ *
+ * Author:	James Letendre
+ *
+ * Finished paths kept by (start, goal). The map is cut into square regions
+ * that remember the cost version of their last change; a cached path stays
+ * good until a region it crosses changes after the path was searched.
+ */
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <ClanLib/core.h>
+
+class PathCache
+{
+	public:
+		/**
+		 * PathCache(w, h, capacity, region_size)
+		 *
+		 * Cache up to capacity paths on a w by h map, the least recently used
+		 * is dropped first
+		 */
+		PathCache( size_t w, size_t h, size_t capacity = 1024, int region_size = 16 );
+
+		/**
+		 * Copy out the path from start to goal if one is cached and no region
+		 * it crosses changed since. Same conventions as PathSearch::findPath.
+		 */
+		bool lookup( int start_x, int start_y, int goal_x, int goal_y,
+				std::vector<CL_Point> &path, double *cost = NULL );
+
+		/**
+		 * Remember a path searched against costs at the given version
+		 */
+		void store( int start_x, int start_y, int goal_x, int goal_y,
+				const std::vector<CL_Point> &path, double cost, uint64_t version );
+
+		/**
+		 * Costs inside rect changed, bringing every region it overlaps up to
+		 * version
+		 */
+		void regionChanged( const CL_Rect &rect, uint64_t version );
+
+		void clear();
+
+		size_t getSize() const { return entries.size(); }
+		size_t getCapacity() const { return capacity; }
+
+		size_t getHits() const { return hits; }
+		size_t getMisses() const { return misses; }
+		size_t getInvalidations() const { return invalidations; }
+		size_t getEvictions() const { return evictions; }
+
+		/**
+		 * Approximate bytes held by cached paths
+		 */
+		size_t getMemoryUsage() const { return memory; }
+
+	private:
+		typedef struct
+		{
+			uint64_t key;
+
+			/// Cost version the path was searched against
+			uint64_t version;
+
+			double cost;
+			std::vector<CL_Point> path;
+
+			/// Regions the path crosses, sorted
+			std::vector<uint32_t> regions;
+		} entry_t;
+
+		typedef std::list<entry_t> entry_list;
+
+		uint64_t makeKey( int start_x, int start_y, int goal_x, int goal_y ) const;
+		uint32_t regionOf( int x, int y ) const;
+
+		bool isCurrent( const entry_t &entry ) const;
+		size_t entrySize( const entry_t &entry ) const;
+		void erase( entry_list::iterator iter );
+
+		size_t width, height;
+		size_t capacity;
+
+		int region_size;
+		size_t regions_wide;
+
+		/// Cost version of the last change in each region
+		std::vector<uint64_t> region_versions;
+
+		/// Most recently used first
+		entry_list entries;
+		std::unordered_map<uint64_t, entry_list::iterator> index;
+
+		size_t hits, misses, invalidations, evictions;
+		size_t memory;
+};
+
+#endif
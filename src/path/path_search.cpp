@@ -0,0 +1,532 @@
+/*
+ * File:	path_search.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Reusable A* search context over a grid of move costs
+ */
+
+#include "path/path_search.h"
+#include "path/grid_moves.h"
+#include "map/cost_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// give up after expanding this many nodes
+#define MAX_EXPANSIONS	10000000
+
+// fixed point scale for BUCKET, 70*sqrt(2) is within 0.01% of 99
+#define COST_SCALE	70
+
+PathSearch::PathSearch( const CostGrid *grid )
+	: grid(grid), width(0), height(0), stride(0), generation(0), nodes_expanded(0)
+{
+}
+
+/*
+ * Grow the per-node storage to the size of the grid
+ */
+void PathSearch::resize()
+{
+	if( width == grid->getWidth() && height == grid->getHeight() ) return;
+
+	width = grid->getWidth();
+	height = grid->getHeight();
+	stride = grid->getStride();
+
+	// nodes are numbered like the grid's cells, border included
+	const size_t size = grid->getSize();
+
+	open_stamp.assign( size, 0 );
+	closed_stamp.assign( size, 0 );
+	costs.resize( size );
+	parents.resize( size );
+	fixed_costs.clear();
+	generation = 0;
+
+	for( int i = 0; i < NUM_SUCCESSORS; i++ )
+		offsets[i] = successors[i].dy*(int)stride + successors[i].dx;
+}
+
+/*
+ * Close the ring of cells around the bounds, so expanding a node never
+ * needs to check them
+ */
+void PathSearch::closeBounds()
+{
+	for( int x = min_x - 1; x <= max_x; x++ )
+	{
+		closed_stamp[grid->index(x, min_y - 1)] = generation;
+		closed_stamp[grid->index(x, max_y)] = generation;
+	}
+	for( int y = min_y; y < max_y; y++ )
+	{
+		closed_stamp[grid->index(min_x - 1, y)] = generation;
+		closed_stamp[grid->index(max_x, y)] = generation;
+	}
+}
+
+/*
+ * Bump the query stamp, only clearing the stamps when it wraps around
+ */
+void PathSearch::nextGeneration()
+{
+	if( ++generation == 0 )
+	{
+		std::fill( open_stamp.begin(), open_stamp.end(), 0 );
+		std::fill( closed_stamp.begin(), closed_stamp.end(), 0 );
+		generation = 1;
+	}
+}
+
+/*
+ * Cell inside the bounds and not an obstacle
+ */
+inline bool PathSearch::passable( int x, int y ) const
+{
+	return x >= min_x && x < max_x && y >= min_y && y < max_y && grid->get(x, y) >= 0;
+}
+
+/*
+ * A passable neighbour with a different cost, jumps can't see past it
+ */
+bool PathSearch::isBoundary( int x, int y ) const
+{
+	const float c = grid->get(x, y);
+
+	for( int i = 0; i < NUM_SUCCESSORS; i++ )
+	{
+		const int nx = x + successors[i].dx;
+		const int ny = y + successors[i].dy;
+
+		if( passable(nx, ny) && grid->get(nx, ny) != c ) return true;
+	}
+	return false;
+}
+
+inline bool PathSearch::isTarget( int x, int y ) const
+{
+	return ( x == target_x && y == target_y ) ||
+		( target_radius > 1.0 && hypot(target_x - x, target_y - y) < target_radius );
+}
+
+/*
+ * Add or improve an open node
+ */
+inline void PathSearch::relax( uint32_t parent, int x, int y, double child_cost )
+{
+	const uint32_t child = grid->index(x, y);
+
+	// if the cell is already in the tentative list,
+	// we need to make sure we don't have a higher cost here
+	if( open_stamp[child] == generation && costs[child] <= child_cost ) return;
+
+	open_stamp[child] = generation;
+	costs[child] = child_cost;
+	parents[child] = parent;
+
+	// weight is cost + heuristic
+	queue.push_back( (node_t){child, child_cost + h_scale * octile_distance(target_x - x, target_y - y)} );
+	std::push_heap( queue.begin(), queue.end(), best_weight_compare<node_t> );
+}
+
+/*
+ * Plain A* successors, every neighbour
+ */
+void PathSearch::expandNeighbours( uint32_t head, int x, int y )
+{
+	const double head_cost = costs[head];
+
+	// the map's border and the ring around the bounds are never open, so
+	// neighbours need no bounds checks
+	for( int i = 0; i < NUM_SUCCESSORS; i++ )
+	{
+		const uint32_t child = head + offsets[i];
+		if( closed_stamp[child] == generation ) continue;
+
+		const double p = grid->at(child);
+		if( p < 0 )
+		{
+			// don't consider obstacles at all
+			closed_stamp[child] = generation;
+			continue;
+		}
+
+		// accumulate cost
+		relax( head, x + successors[i].dx, y + successors[i].dy, head_cost + successors[i].weight * p );
+	}
+}
+
+/*
+ * Jump point successors. Away from cost boundaries only the natural and
+ * forced neighbours for the direction we arrived in are followed.
+ */
+void PathSearch::expandJumps( uint32_t head, int x, int y )
+{
+	const double head_cost = costs[head];
+	const uint32_t parent = parents[head];
+
+	// cost boundaries get every neighbour, jumps take over past them
+	if( parent == head || isBoundary(x, y) )
+	{
+		expandNeighbours( head, x, y );
+		return;
+	}
+
+	int dirs[NUM_SUCCESSORS][2];
+	int num_dirs = 0;
+
+	const int px = nodeX(parent), py = nodeY(parent);
+	const int dx = (x > px) - (x < px);
+	const int dy = (y > py) - (y < py);
+
+	#define ADD_DIR(a, b) { dirs[num_dirs][0] = (a); dirs[num_dirs][1] = (b); num_dirs++; }
+	if( dx && dy )
+	{
+		ADD_DIR( dx, 0 );
+		ADD_DIR( 0, dy );
+		ADD_DIR( dx, dy );
+		if( !passable(x - dx, y) ) ADD_DIR( -dx, dy );
+		if( !passable(x, y - dy) ) ADD_DIR( dx, -dy );
+	}
+	else if( dx )
+	{
+		ADD_DIR( dx, 0 );
+		if( !passable(x, y + 1) ) ADD_DIR( dx, 1 );
+		if( !passable(x, y - 1) ) ADD_DIR( dx, -1 );
+	}
+	else
+	{
+		ADD_DIR( 0, dy );
+		if( !passable(x + 1, y) ) ADD_DIR( 1, dy );
+		if( !passable(x - 1, y) ) ADD_DIR( -1, dy );
+	}
+	#undef ADD_DIR
+
+	for( int i = 0; i < num_dirs; i++ )
+	{
+		int jx = x, jy = y;
+		double jump_cost = 0;
+
+		if( !jump( jx, jy, dirs[i][0], dirs[i][1], &jump_cost ) ) continue;
+		if( closed_stamp[grid->index(jx, jy)] == generation ) continue;
+
+		relax( head, jx, jy, head_cost + jump_cost );
+	}
+}
+
+/*
+ * Three cells across a straight jump, all inside the bounds and costing c
+ */
+inline bool PathSearch::uniformLine( int x, int y, int px, int py, float c ) const
+{
+	return x - px >= min_x && x + px < max_x && y - py >= min_y && y + py < max_y &&
+		grid->get(x - px, y - py) == c && grid->get(x, y) == c && grid->get(x + px, y + py) == c;
+}
+
+/*
+ * Walk to the next jump point: the start, a cell on a cost boundary, or a
+ * cell with a forced neighbour
+ */
+bool PathSearch::jump( int &x, int &y, int dx, int dy, double *cost )
+{
+	if( !( dx && dy ) ) return jumpStraight( x, y, dx, dy, cost );
+
+	for(;;)
+	{
+		x += dx;
+		y += dy;
+
+		if( !passable(x, y) ) return false;
+
+		// backwards, so stepping onto a cell costs that cell
+		if (cost) *cost += M_SQRT2 * grid->get(x, y);
+
+		if( isTarget(x, y) || isBoundary(x, y) ) return true;
+
+		if( ( !passable(x - dx, y) && passable(x - dx, y + dy) ) ||
+				( !passable(x, y - dy) && passable(x + dx, y - dy) ) )
+			return true;
+
+		// diagonals stop where a straight line would find something
+		int sx = x, sy = y;
+		if( jumpStraight(sx, sy, dx, 0, NULL) ) return true;
+
+		sx = x, sy = y;
+		if( jumpStraight(sx, sy, 0, dy, NULL) ) return true;
+	}
+}
+
+/*
+ * Straight jumps slide a window of three lines across the run; a cell
+ * whose lines on both sides all match the run's cost can't be a jump point
+ */
+bool PathSearch::jumpStraight( int &x, int &y, int dx, int dy, double *cost )
+{
+	// across the direction of travel
+	const int px = dy ? 1 : 0, py = dx ? 1 : 0;
+
+	if( !passable(x + dx, y + dy) ) return false;
+	const float c = grid->get(x + dx, y + dy);
+
+	bool behind = uniformLine( x, y, px, py, c );
+	bool here = uniformLine( x + dx, y + dy, px, py, c );
+
+	for(;;)
+	{
+		x += dx;
+		y += dy;
+
+		if( !passable(x, y) ) return false;
+
+		if (cost) *cost += grid->get(x, y);
+
+		if( isTarget(x, y) ) return true;
+
+		const bool ahead = uniformLine( x + dx, y + dy, px, py, c );
+		if( !( behind && here && ahead ) )
+		{
+			if( isBoundary(x, y) ) return true;
+
+			if( ( !passable(x - px, y - py) && passable(x + dx - px, y + dy - py) ) ||
+					( !passable(x + px, y + py) && passable(x + dx + px, y + dy + py) ) )
+				return true;
+		}
+
+		behind = here;
+		here = ahead;
+	}
+}
+
+/*
+ * Octile distance to the start in fixed point. The steps are rounded the
+ * same way as the moves, so the estimate stays consistent.
+ */
+inline uint32_t PathSearch::fixedHeuristic( int x, int y ) const
+{
+	const int dx = abs(target_x - x), dy = abs(target_y - y);
+	const int diagonal = std::min( dx, dy );
+
+	return (std::max( dx, dy ) - diagonal)*h_straight + diagonal*h_diagonal;
+}
+
+/*
+ * A* over fixed point costs. Estimates only grow, and by at most two of
+ * the dearest steps per expansion, so a ring of buckets a little larger
+ * than that holds every open node.
+ */
+bool PathSearch::searchBuckets( uint32_t init, uint32_t &found )
+{
+	if( fixed_costs.size() != grid->getSize() )
+		fixed_costs.resize( grid->getSize() );
+
+	// heuristic steps, rounded like a move out of the cheapest cell
+	h_straight = lround( h_scale * COST_SCALE );
+	h_diagonal = lround( h_scale * M_SQRT2 * COST_SCALE );
+
+	const uint32_t max_step = lround( grid->getMaxCost() * M_SQRT2 * COST_SCALE );
+
+	size_t num_buckets = 1;
+	while( num_buckets < 2*max_step + 2 ) num_buckets <<= 1;
+	if( buckets.size() < num_buckets ) buckets.resize( num_buckets );
+
+	const size_t mask = buckets.size() - 1;
+
+	uint32_t estimate = fixedHeuristic( nodeX(init), nodeY(init) );
+	fixed_costs[init] = 0;
+	buckets[estimate & mask].push_back( init );
+	size_t pending = 1;
+
+	bool success = false;
+	while( pending > 0 && nodes_expanded <= MAX_EXPANSIONS )
+	{
+		// next non-empty bucket, nothing open is ever below the current one
+		std::vector<uint32_t> *bucket = &buckets[estimate & mask];
+		while( bucket->empty() )
+			bucket = &buckets[++estimate & mask];
+
+		const uint32_t head = bucket->back();
+		bucket->pop_back();
+		pending--;
+
+		const int head_x = nodeX(head);
+		const int head_y = nodeY(head);
+
+		// found the start yet?
+		if( isTarget(head_x, head_y) )
+		{
+			found = head;
+			success = true;
+			break;
+		}
+
+		// an older entry for a node improved since
+		if( closed_stamp[head] == generation ) continue;
+		closed_stamp[head] = generation;
+
+		const uint32_t head_cost = fixed_costs[head];
+
+		// moves out of the last cost seen, most neighbours share it
+		float last_p = -1;
+		uint32_t step[2] = {0, 0};
+
+		for( int i = 0; i < NUM_SUCCESSORS; i++ )
+		{
+			const uint32_t child = head + offsets[i];
+			if( closed_stamp[child] == generation ) continue;
+
+			const float p = grid->at(child);
+			if( p < 0 )
+			{
+				// don't consider obstacles at all
+				closed_stamp[child] = generation;
+				continue;
+			}
+
+			if( p != last_p )
+			{
+				last_p = p;
+				step[0] = lround( p * COST_SCALE );
+				step[1] = lround( p * M_SQRT2 * COST_SCALE );
+			}
+
+			const uint32_t child_cost = head_cost + step[ successors[i].dx && successors[i].dy ];
+			if( open_stamp[child] == generation && fixed_costs[child] <= child_cost ) continue;
+
+			open_stamp[child] = generation;
+			fixed_costs[child] = child_cost;
+			parents[child] = head;
+
+			buckets[(child_cost + fixedHeuristic(head_x + successors[i].dx, head_y + successors[i].dy)) & mask].push_back( child );
+			pending++;
+		}
+
+		nodes_expanded++;
+	}
+
+	// leave the ring empty for the next query
+	if( pending > 0 )
+	{
+		for( std::vector<uint32_t> &b : buckets ) b.clear();
+	}
+
+	return success;
+}
+
+bool PathSearch::findPath( int start_x, int start_y, int goal_x, int goal_y,
+		std::vector<CL_Point> &path, double *cost, double accuracy, const CL_Rect *bounds, int mode )
+{
+	resize();
+	nextGeneration();
+
+	nodes_expanded = 0;
+	queue.clear();
+
+	// area the search may cover
+	min_x = 0, min_y = 0, max_x = width, max_y = height;
+	if( bounds )
+	{
+		min_x = std::max( min_x, bounds->left );
+		min_y = std::max( min_y, bounds->top );
+		max_x = std::min( max_x, bounds->right );
+		max_y = std::min( max_y, bounds->bottom );
+	}
+
+	if( goal_x < min_x || goal_x >= max_x || goal_y < min_y || goal_y >= max_y ||
+			start_x < min_x || start_x >= max_x || start_y < min_y || start_y >= max_y )
+	{
+		if (cost) *cost = std::numeric_limits<double>::infinity();
+		return false;
+	}
+
+	// no step can be cheaper than the cheapest cell on the map
+	h_scale = grid->getMinCost();
+
+	// backwards so path comes out in the right order
+	target_x = start_x;
+	target_y = start_y;
+	target_radius = accuracy;
+
+	if( bounds ) closeBounds();
+
+	const uint32_t init = grid->index(goal_x, goal_y);
+
+	// insert first node which is the goal pose
+	open_stamp[init] = generation;
+	costs[init] = 0;
+	parents[init] = init;
+
+	node_t head;
+	if( mode == BUCKET )
+	{
+		if( !searchBuckets( init, head.index ) )
+		{
+			if (cost) *cost = std::numeric_limits<double>::infinity();
+			return false;
+		}
+	}
+	else for( queue.push_back( (node_t){init, h_scale * octile_distance(start_x - goal_x, start_y - goal_y)} );; )
+	{
+		// no path found?
+		if( queue.empty() || nodes_expanded > MAX_EXPANSIONS )
+		{
+			if (cost) *cost = std::numeric_limits<double>::infinity();
+			return false;
+		}
+
+		// copy the head of the queue
+		std::pop_heap( queue.begin(), queue.end(), best_weight_compare<node_t> );
+		head = queue.back();
+		queue.pop_back();
+
+		const int head_x = nodeX(head.index);
+		const int head_y = nodeY(head.index);
+
+		// found the start yet?
+		if( isTarget(head_x, head_y) ) break;
+
+		// mark it as already seen
+		if( closed_stamp[head.index] == generation ) continue;
+		closed_stamp[head.index] = generation;
+
+		// find successors
+		if( mode == JUMP_POINT )
+			expandJumps( head.index, head_x, head_y );
+		else
+			expandNeighbours( head.index, head_x, head_y );
+
+		nodes_expanded++;
+	}
+
+	// cost output, the bucket search adds it up from the path below
+	if (cost) *cost = ( mode == BUCKET ) ? 0 : costs[head.index];
+
+	// walk the parents back to the goal, filling in the cells between jump
+	// points, then flip so the next step is at the back
+	path.clear();
+	for( uint32_t next = head.index; next != init; )
+	{
+		int x = nodeX(next), y = nodeY(next);
+
+		next = parents[next];
+
+		const int px = nodeX(next), py = nodeY(next);
+		const int dx = (px > x) - (px < x);
+		const int dy = (py > y) - (py < y);
+
+		do
+		{
+			if( mode == BUCKET && cost )
+				*cost += ( (dx && dy) ? M_SQRT2 : 1 ) * grid->get(x, y);
+
+			x += dx;
+			y += dy;
+			path.push_back( CL_Point(x, y) );
+		} while( x != px || y != py );
+	}
+	std::reverse( path.begin(), path.end() );
+
+	return true;
+}
@@ -0,0 +1,157 @@
+/*
+ * File:	path_search.h
+ *
+ * Author:	James Letendre
+ *
+ * Reusable A* search context over a grid of move costs
+ */
+#ifndef PATH_SEARCH_H
+#define PATH_SEARCH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <ClanLib/core.h>
+
+class CostGrid;
+
+class PathSearch
+{
+	public:
+		/// How a query expands its nodes
+		enum
+		{
+			/// Every neighbour of every node
+			ASTAR,
+
+			/// Jump over runs of equal cost, expanding fully only at cost
+			/// boundaries. Same costs as ASTAR, far fewer nodes on open ground.
+			JUMP_POINT,
+
+			/// ASTAR over fixed point costs with a bucket queue (Dial's
+			/// algorithm). Optimal for the rounded costs, which are within
+			/// about 0.01% of the real ones.
+			BUCKET
+		};
+
+		/**
+		 * PathSearch(grid)
+		 *
+		 * Create a search context over the move costs in grid. Storage is
+		 * sized to the grid on the first query and reused by every query after
+		 * that.
+		 */
+		PathSearch( const CostGrid *grid = NULL );
+
+		/**
+		 * Search a different grid of the same or another size
+		 */
+		void setGrid( const CostGrid *grid ) { this->grid = grid; }
+
+		/**
+		 * Find a path from start to goal.
+		 *
+		 * The path is stored last step first, so path.back() is the first cell
+		 * to move to and path.front() is the goal. The start cell is not part of
+		 * the path. On failure path is left untouched.
+		 *
+		 * If bounds is given the search never leaves that rectangle. mode is
+		 * ASTAR, JUMP_POINT or BUCKET.
+		 */
+		bool findPath( int start_x, int start_y, int goal_x, int goal_y,
+				std::vector<CL_Point> &path, double *cost = NULL, double accuracy = 1.0,
+				const CL_Rect *bounds = NULL, int mode = ASTAR );
+
+		/**
+		 * Number of nodes expanded by the last query
+		 */
+		size_t getNodesExpanded() const { return nodes_expanded; }
+
+	private:
+		// entry in the open list
+		typedef struct
+		{
+			uint32_t index;
+			double weight;
+		} node_t;
+
+		// make sure the storage matches the grid size
+		void resize();
+
+		// mark the cells just outside the bounds closed
+		void closeBounds();
+
+		// position of a node, numbered like the grid's cells
+		int nodeX( uint32_t index ) const { return index % stride - 1; }
+		int nodeY( uint32_t index ) const { return index / stride - 1; }
+
+		// start a new query, invalidating all per-node data
+		void nextGeneration();
+
+		// add or improve an open node
+		void relax( uint32_t parent, int x, int y, double child_cost );
+
+		// A* with the bucket queue, sets found to the node reached
+		bool searchBuckets( uint32_t init, uint32_t &found );
+
+		// fixed point heuristic from (x,y) to the start
+		uint32_t fixedHeuristic( int x, int y ) const;
+
+		// successors of a node, every neighbour or the jump points
+		void expandNeighbours( uint32_t head, int x, int y );
+		void expandJumps( uint32_t head, int x, int y );
+
+		// walk from (x,y) in direction (dx,dy) to the next jump point,
+		// adding the cost of the cells stepped on to cost if given
+		bool jump( int &x, int &y, int dx, int dy, double *cost );
+		bool jumpStraight( int &x, int &y, int dx, int dy, double *cost );
+
+		// three cells across a straight jump all cost c
+		bool uniformLine( int x, int y, int px, int py, float c ) const;
+
+		// cell inside the bounds and not an obstacle
+		bool passable( int x, int y ) const;
+
+		// a passable neighbour costs something else
+		bool isBoundary( int x, int y ) const;
+
+		// close enough to the start to stop
+		bool isTarget( int x, int y ) const;
+
+		const CostGrid *grid;
+
+		/// Size of the storage, and the grid's row length with its border
+		size_t width, height;
+		size_t stride;
+
+		/// Node index step to each successor
+		int offsets[8];
+
+		/// Stamp of the current query
+		uint32_t generation;
+
+		/// Per-node data, valid only if the stamp matches the current generation
+		std::vector<uint32_t> open_stamp;
+		std::vector<uint32_t> closed_stamp;
+		std::vector<double> costs;
+		std::vector<uint32_t> parents;
+
+		/// Open list, kept as a binary heap
+		std::vector<node_t> queue;
+
+		/// Fixed point costs and the circular bucket queue for BUCKET,
+		/// indexed by estimate modulo the number of buckets
+		std::vector<uint32_t> fixed_costs;
+		std::vector< std::vector<uint32_t> > buckets;
+		uint32_t h_straight, h_diagonal;
+
+		/// Area, start and heuristic scale of the current query
+		int min_x, min_y, max_x, max_y;
+		int target_x, target_y;
+		double target_radius;
+		double h_scale;
+
+		size_t nodes_expanded;
+};
+
+#endif
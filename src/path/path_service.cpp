@@ -0,0 +1,329 @@
+/*
+ * File:	path_service.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Asynchronous path requests served by worker threads
+ */
+
+#include "path/path_service.h"
+#include "map/map.h"
+
+#include <algorithm>
+
+// changes kept for the cluster graph before it is thrown away and rebuilt
+#define MAX_GRAPH_CHANGES	65536
+
+// cluster size of the shared graph, trips shorter than two clusters skip it
+#define GRAPH_CLUSTER_SIZE	32
+
+PathService::PathService( Map *map, int threads )
+	: map(map), quit(false), next_ticket(NO_TICKET), active(0),
+	cache(map->getWidth(), map->getHeight()), graph(NULL), graph_stale(true), graph_building(false), graph_min_version(0),
+	graph_behind(false), inline_context(&inline_search)
+{
+	if( threads > 0 )
+	{
+		// have the graph built before the first long trip asks for it
+		newest_grid = map->getCostSnapshot();
+		graph_behind = true;
+	}
+
+	for( int i = 0; i < threads; i++ )
+	{
+		workers.push_back( std::thread( &PathService::work, this ) );
+	}
+}
+
+PathService::~PathService()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		quit = true;
+	}
+	wakeup.notify_all();
+
+	for( std::thread &t : workers )
+	{
+		t.join();
+	}
+
+	delete graph;
+}
+
+/*
+ * Queue a search from start to goal
+ */
+PathService::ticket_t PathService::submit( int start_x, int start_y, int goal_x, int goal_y )
+{
+	if( ++next_ticket == NO_TICKET ) ++next_ticket;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+
+		result_t &result = results[next_ticket];
+
+		// walled off, no search would find anything
+		if( !map->isReachable( start_x, start_y, goal_x, goal_y ) )
+		{
+			result.found = false;
+			result.cost = 0;
+			return next_ticket;
+		}
+
+		if( cache.lookup( start_x, start_y, goal_x, goal_y, result.path, &result.cost ) )
+		{
+			result.found = true;
+			result.cached = true;
+			return next_ticket;
+		}
+		results.erase( next_ticket );
+	}
+
+	request_t req = { next_ticket, start_x, start_y, goal_x, goal_y, map->getCostSnapshot() };
+
+	if( workers.empty() )
+	{
+		// nobody to hand it to, answer it now
+		inline_search.setGrid( req.grid.get() );
+		solve( req, inline_search, inline_context, results[req.ticket] );
+		return req.ticket;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		requests.push_back( req );
+
+		if( !newest_grid || req.grid->getVersion() > newest_grid->getVersion() )
+		{
+			newest_grid = req.grid;
+			graph_behind = true;
+		}
+	}
+	wakeup.notify_one();
+
+	return req.ticket;
+}
+
+/*
+ * Check on a request
+ */
+int PathService::poll( ticket_t ticket, std::vector<CL_Point> &path, double *cost )
+{
+	std::lock_guard<std::mutex> lock( mutex );
+
+	auto iter = results.find( ticket );
+	if( iter == results.end() ) return PENDING;
+
+	result_t &result = iter->second;
+
+	const bool found = result.found;
+	if( found )
+	{
+		if( !result.cached )
+		{
+			cache.store( result.start_x, result.start_y, result.goal_x, result.goal_y,
+					result.path, result.cost, result.version );
+		}
+		path.swap( result.path );
+	}
+	if (cost) *cost = result.cost;
+
+	results.erase( iter );
+
+	return found ? FOUND : FAILED;
+}
+
+/*
+ * Forget about a request
+ */
+void PathService::cancel( ticket_t ticket )
+{
+	std::lock_guard<std::mutex> lock( mutex );
+
+	if( results.erase( ticket ) ) return;
+
+	// still queued or being searched, drop it when a worker gets to it
+	cancelled.insert( ticket );
+}
+
+/*
+ * Remember the change for the cache and the cluster graph
+ */
+void PathService::regionChanged( const CL_Rect &rect, uint64_t version )
+{
+	std::lock_guard<std::mutex> lock( mutex );
+
+	cache.regionChanged( rect, version );
+
+	graph_changes.push_back( (change_t){version, rect} );
+
+	if( graph_changes.size() > MAX_GRAPH_CHANGES )
+	{
+		// too far behind to catch up edit by edit, start the graph over
+		graph_changes.clear();
+		graph_stale = true;
+		graph_min_version = version;
+	}
+}
+
+size_t PathService::getPending()
+{
+	std::lock_guard<std::mutex> lock( mutex );
+	return requests.size() + active;
+}
+
+/*
+ * Worker thread main loop
+ */
+void PathService::work()
+{
+	PathSearch search;
+	ClusterGraph::Context context( &search );
+	result_t result;
+
+	for(;;)
+	{
+		request_t req;
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			wakeup.wait( lock, [this]{ return quit || !requests.empty() || graph_behind; } );
+
+			if( quit ) return;
+
+			if( requests.empty() )
+			{
+				// nothing asked, bring the graph up to date meanwhile
+				std::shared_ptr<const CostGrid> grid = newest_grid;
+				graph_behind = false;
+				lock.unlock();
+
+				refreshGraph( grid );
+				continue;
+			}
+
+			req = requests.front();
+			requests.pop_front();
+
+			if( cancelled.erase( req.ticket ) ) continue;
+
+			active++;
+		}
+
+		search.setGrid( req.grid.get() );
+		solve( req, search, context, result );
+
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			active--;
+
+			if( !cancelled.erase( req.ticket ) )
+			{
+				results[req.ticket] = std::move( result );
+			}
+		}
+	}
+}
+
+/*
+ * Answer one request
+ */
+void PathService::solve( const request_t &req, PathSearch &search, ClusterGraph::Context &context, result_t &result )
+{
+	const int distance = std::max( abs(req.goal_x - req.start_x), abs(req.goal_y - req.start_y) );
+
+	result.start_x = req.start_x;
+	result.start_y = req.start_y;
+	result.goal_x = req.goal_x;
+	result.goal_y = req.goal_y;
+	result.version = req.grid->getVersion();
+	result.cached = false;
+
+	if( distance < 2*GRAPH_CLUSTER_SIZE )
+	{
+		result.found = search.findPath( req.start_x, req.start_y, req.goal_x, req.goal_y, result.path, &result.cost );
+		return;
+	}
+
+	// long trips go over the cluster graph, which any number of workers
+	// search at once
+	if( refreshGraph( req.grid ) )
+	{
+		std::shared_lock<std::shared_timed_mutex> read( graph_mutex );
+		result.found = graph->findPath( context, req.start_x, req.start_y, req.goal_x, req.goal_y, result.path, &result.cost );
+		return;
+	}
+
+	// no graph to use yet
+	result.found = search.findPath( req.start_x, req.start_y, req.goal_x, req.goal_y, result.path, &result.cost );
+}
+
+/*
+ * Move the graph on to grid if it is newer, and rebuild what changed. A new
+ * graph is built without holding up searches on the old one. False if there
+ * is no graph to use with grid.
+ */
+bool PathService::refreshGraph( const std::shared_ptr<const CostGrid> &grid )
+{
+	bool start_over;
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		start_over = graph_stale;
+
+		if( start_over )
+		{
+			// changes before the graph was dropped are forgotten, so it can
+			// only start over on a grid that has them
+			if( graph_building || grid->getVersion() < graph_min_version ) return false;
+			graph_building = true;
+		}
+	}
+
+	if( start_over )
+	{
+		ClusterGraph *fresh = new ClusterGraph( grid.get(), GRAPH_CLUSTER_SIZE );
+		fresh->update();
+
+		std::lock_guard<std::shared_timed_mutex> write( graph_mutex );
+		std::lock_guard<std::mutex> lock( mutex );
+
+		delete graph;
+		graph = fresh;
+		graph_grid = grid;
+		graph_stale = grid->getVersion() < graph_min_version;
+		graph_building = false;
+
+		// the build already has these
+		while( !graph_changes.empty() && graph_changes.front().version <= grid->getVersion() )
+		{
+			graph_changes.pop_front();
+		}
+		return true;
+	}
+
+	{
+		std::shared_lock<std::shared_timed_mutex> read( graph_mutex );
+		if( grid->getVersion() <= graph_grid->getVersion() ) return true;
+	}
+
+	// a newer grid, searches wait only while the changed clusters rebuild
+	std::lock_guard<std::shared_timed_mutex> write( graph_mutex );
+
+	if( grid->getVersion() > graph_grid->getVersion() )
+	{
+		graph->setGrid( grid.get() );
+		graph_grid = grid;
+
+		std::lock_guard<std::mutex> lock( mutex );
+
+		// catch the graph up with the snapshot it now reads
+		while( !graph_changes.empty() && graph_changes.front().version <= graph_grid->getVersion() )
+		{
+			graph->regionChanged( graph_changes.front().rect );
+			graph_changes.pop_front();
+		}
+	}
+
+	graph->update();
+	return true;
+}
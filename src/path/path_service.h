@@ -0,0 +1,171 @@
+/*
+ * File:	path_service.h
+ *
+ * Author:	James Letendre
+ *
+ * Asynchronous path requests, answered by a pool of worker threads that
+ * search read only snapshots of the map's move costs
+ */
+#ifndef PATH_SERVICE_H
+#define PATH_SERVICE_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ClanLib/core.h>
+
+#include "map/cost_grid.h"
+#include "path/cluster_graph.h"
+#include "path/path_cache.h"
+
+class Map;
+
+class PathService
+{
+	public:
+		typedef uint32_t ticket_t;
+
+		/// Ticket value that never names a request
+		static const ticket_t NO_TICKET = 0;
+
+		enum
+		{
+			PENDING,
+			FOUND,
+			FAILED
+		};
+
+		/**
+		 * PathService(map, threads)
+		 *
+		 * Serve path requests on the map with the given number of worker
+		 * threads. With no threads requests are answered inside submit().
+		 */
+		PathService( Map *map, int threads );
+		~PathService();
+
+		/**
+		 * Queue a search from start to goal, poll the returned ticket for the
+		 * result on later ticks. Goals the map knows to be unreachable fail
+		 * without a search.
+		 */
+		ticket_t submit( int start_x, int start_y, int goal_x, int goal_y );
+
+		/**
+		 * Check on a request. Once FOUND or FAILED is returned the ticket is
+		 * spent; on FOUND path and cost hold the result, same conventions as
+		 * PathSearch::findPath.
+		 */
+		int poll( ticket_t ticket, std::vector<CL_Point> &path, double *cost = NULL );
+
+		/**
+		 * Forget about a request, its result is thrown away
+		 */
+		void cancel( ticket_t ticket );
+
+		/**
+		 * Move costs inside rect changed, bringing them to version. Called by
+		 * the map once per edit.
+		 */
+		void regionChanged( const CL_Rect &rect, uint64_t version );
+
+		/**
+		 * Number of requests queued or being searched
+		 */
+		size_t getPending();
+
+		/**
+		 * Paths answered without a search, for sizing the cache
+		 */
+		const PathCache& getCache() const { return cache; }
+
+		int getThreadCount() const { return workers.size(); }
+
+	private:
+		typedef struct
+		{
+			ticket_t ticket;
+			int start_x, start_y, goal_x, goal_y;
+			std::shared_ptr<const CostGrid> grid;
+		} request_t;
+
+		typedef struct
+		{
+			bool found;
+			double cost;
+			std::vector<CL_Point> path;
+
+			/// What was asked and the cost version it was searched against,
+			/// for the cache
+			int start_x, start_y, goal_x, goal_y;
+			uint64_t version;
+			bool cached;
+		} result_t;
+
+		typedef struct
+		{
+			uint64_t version;
+			CL_Rect rect;
+		} change_t;
+
+		// worker thread main loop
+		void work();
+
+		// answer one request, search and context are owned by the calling
+		// thread
+		void solve( const request_t &req, PathSearch &search, ClusterGraph::Context &context, result_t &result );
+
+		// move the graph on to a newer grid and rebuild what changed
+		bool refreshGraph( const std::shared_ptr<const CostGrid> &grid );
+
+		Map *map;
+
+		std::vector<std::thread> workers;
+
+		std::mutex mutex;
+		std::condition_variable wakeup;
+		bool quit;
+
+		ticket_t next_ticket;
+		std::deque<request_t> requests;
+		std::unordered_map<ticket_t, result_t> results;
+		std::unordered_set<ticket_t> cancelled;
+		size_t active;
+
+		/// Finished paths, guarded by mutex
+		PathCache cache;
+
+		/// Long trips share one cluster graph, which follows the newest
+		/// snapshot any request has seen. Searches hold graph_mutex shared,
+		/// moving the graph on holds it exclusively.
+		std::shared_timed_mutex graph_mutex;
+		ClusterGraph *graph;
+		std::shared_ptr<const CostGrid> graph_grid;
+
+		/// Changes the graph has yet to see, and whether it fell too far
+		/// behind and must be built over, guarded by mutex
+		std::deque<change_t> graph_changes;
+		bool graph_stale, graph_building;
+
+		/// Oldest snapshot version the graph may be built over on
+		uint64_t graph_min_version;
+
+		/// Newest snapshot submitted, idle workers rebuild the graph on it
+		/// ahead of the long trips while graph_behind is set
+		std::shared_ptr<const CostGrid> newest_grid;
+		bool graph_behind;
+
+		/// Search used when there are no workers
+		PathSearch inline_search;
+		ClusterGraph::Context inline_context;
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * File:	cell_draw.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Drawing a cell with the game's tileset
+ */
+
+#include "render/renderer.h"
+#include "map/cell.h"
+#include "map/tileset.h"
+
+#define MIN_BUILD_ALPHA	0.3
+
+/*
+ * drawCell(gc, cell)
+ *
+ * Draw a cell
+ */
+void Renderer::drawCell( CL_GraphicContext &gc, const Cell &cell, double width, double height, int idx )
+{
+	double build_percent = cell.getBuildProgress() * ( 1.0 - MIN_BUILD_ALPHA ) + MIN_BUILD_ALPHA;
+
+	CL_Sprite &sprite( tileset );
+
+	// Draw the base tile
+	sprite.set_frame( cell.getBaseType() );
+	sprite.set_scale( width/TILESET_SIZE, height/TILESET_SIZE );
+	sprite.set_alpha( 1.0 );
+	sprite.draw( gc, 0, 0 );
+
+	// if there is an improvement, draw that too
+	if( !cell.hasBuilding() || idx >= sprite.get_frame_count() ) return;
+
+	sprite.set_frame( idx );
+	sprite.set_scale( width/TILESET_SIZE, height/TILESET_SIZE );
+	sprite.set_alpha( build_percent );
+	sprite.draw( gc, 0, 0 );
+}
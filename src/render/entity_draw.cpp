@@ -0,0 +1,34 @@
+/**
+ * File:    entity_draw.cpp
+ *
+ * Author:  Ben Reeves
+ *
+ * Drawing entities with the game's tileset
+ */
+
+#include "render/renderer.h"
+#include "entity/entity.h"
+#include "map/tileset.h"
+
+/**
+ * drawEntity(gc, entity)
+ *
+ * draws the entity on the given graphic context
+ */
+void Renderer::drawEntity(CL_GraphicContext &gc, Entity &entity, double cell_width, double cell_height, double map_origin_x, double map_origin_y, double alpha )
+{
+    double x, y;
+    entity.getDrawPosition(alpha, x, y);
+
+    gc.push_modelview();
+
+    gc.set_translate(x*cell_width + map_origin_x, y*cell_height + map_origin_y, 0);
+	CL_Sprite &sprite( tileset );
+
+	sprite.set_frame( ROBOT_NS_ID );
+	sprite.set_scale( cell_width/TILESET_SIZE, cell_height/TILESET_SIZE );
+
+	sprite.draw( gc, 0, 0 );
+
+    gc.pop_modelview();
+}
@@ -0,0 +1,49 @@
+/*
+ * File:	map_draw.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Drawing the map
+ */
+
+#include "render/renderer.h"
+#include "map/map.h"
+
+Renderer::Renderer( CL_GraphicContext gc, CL_ResourceManager *resources )
+	: tileset(gc, "tileset", resources)
+{
+}
+
+/*
+ * drawMap(gc, map)
+ *
+ * Draw the map using the specified GraphicContext
+ */
+void Renderer::drawMap( CL_GraphicContext &gc, Map &map, double origin_x, double origin_y, double cell_width, double cell_height, double window_width, double window_height )
+{
+	gc.push_modelview();
+
+	// draw each cell
+	for( size_t i = 0; i < map.getWidth(); i++ )
+	{
+		double x_pos = i*cell_width + origin_x;
+
+		if( x_pos < -cell_width ) continue;		// not in window yet, not visible
+		if( x_pos > window_width ) break;		// beyond end of window, not visible
+
+		for( size_t j = 0; j < map.getHeight(); j++ )
+		{
+			double y_pos = j*cell_height + origin_y;
+
+			if( y_pos < -cell_height ) continue;	// not in window yet, not visible
+			if( y_pos > window_height ) break;		// beyond end of window, not visible
+
+			// tileset frame, matched to the neighbours when the building
+			// was placed
+			gc.set_translate((float)x_pos, (float)y_pos, 0);
+			drawCell(gc, map.getCell(i, j), cell_width, cell_height, map.getTileFrame(i, j));
+		}
+	}
+
+	gc.pop_modelview();
+}
@@ -0,0 +1,51 @@
+/*
+ * File:	renderer.h
+ *
+ * Author:	James Letendre
+ *
+ * Draws the map and the entities on it with ClanLib's display. Nothing in
+ * the simulation knows about drawing, so it builds and runs without a
+ * display; only the game links this.
+ */
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <ClanLib/core.h>
+#include <ClanLib/display.h>
+
+class Map;
+class Cell;
+class Entity;
+
+class Renderer
+{
+	public:
+		/**
+		 * Renderer(gc, resources)
+		 *
+		 * Renderer drawing with the tileset from resources
+		 */
+		Renderer( CL_GraphicContext gc, CL_ResourceManager *resources );
+
+		/**
+		 * Draw the cells of map visible in a window_width by window_height
+		 * window, with the map's corner at origin
+		 */
+		void drawMap( CL_GraphicContext &gc, Map &map, double origin_x, double origin_y, double cell_width, double cell_height, double window_width, double window_height );
+
+		/**
+		 * Draw a cell at the current translation, idx is its building's
+		 * tileset frame
+		 */
+		void drawCell( CL_GraphicContext &gc, const Cell &cell, double width, double height, int idx );
+
+		/**
+		 * Draw an entity, alpha of a tick on from its last update
+		 */
+		void drawEntity( CL_GraphicContext &gc, Entity &entity, double cell_width, double cell_height, double map_origin_x, double map_origin_y, double alpha = 0 );
+
+	private:
+		CL_Sprite tileset;
+};
+
+#endif
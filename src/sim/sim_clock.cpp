@@ -0,0 +1,89 @@
+/*
+ * File:	sim_clock.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Fixed timestep clock for the simulation
+ */
+
+#include "sim/sim_clock.h"
+
+#include <math.h>
+
+// real seconds a frame catches up on, longer stalls (a dragged window, a
+// breakpoint) are dropped rather than run all at once
+#define MAX_LAG			0.25
+
+// real seconds a frame spends on ticks before drawing anyway
+#define FRAME_BUDGET	0.025
+
+SimClock::SimClock( double tick_rate )
+	: tick_rate(tick_rate), speed(1.0), paused(false), max_lag(MAX_LAG), frame_budget(FRAME_BUDGET),
+	pending(0), tick(0), dropped(0), frame_time(0), started(false)
+{
+}
+
+void SimClock::beginFrame()
+{
+	const wall_clock_t::time_point now = wall_clock_t::now();
+	double elapsed = 0;
+
+	if( started )
+		elapsed = std::chrono::duration<double>( now - last_frame ).count();
+
+	started = true;
+	last_frame = now;
+
+	beginFrame( elapsed );
+}
+
+void SimClock::beginFrame( double elapsed )
+{
+	frame_time = elapsed;
+	frame_start = wall_clock_t::now();
+
+	if( paused ) return;
+
+	if( elapsed > max_lag )
+	{
+		dropped += (uint64_t)( (elapsed - max_lag) * speed * tick_rate );
+		elapsed = max_lag;
+	}
+
+	pending += elapsed * speed * tick_rate;
+}
+
+bool SimClock::step()
+{
+	if( pending < 1 ) return false;
+
+	// out of time this frame, drop what is due rather than carry it into the
+	// next one and fall further behind
+	if( std::chrono::duration<double>( wall_clock_t::now() - frame_start ).count() > frame_budget )
+	{
+		const double behind = floor( pending );
+		dropped += (uint64_t)behind;
+		pending -= behind;
+		return false;
+	}
+
+	pending -= 1;
+	tick++;
+	return true;
+}
+
+double SimClock::getAlpha() const
+{
+	return pending < 1 ? pending : 1;
+}
+
+void SimClock::setSpeed( double speed )
+{
+	this->speed = speed < 0 ? 0 : speed;
+}
+
+void SimClock::setCatchUp( double max_lag, double frame_budget )
+{
+	this->max_lag = max_lag;
+	this->frame_budget = frame_budget;
+}
@@ -0,0 +1,105 @@
+/*
+ * File:	sim_clock.h
+ *
+ * Author:	James Letendre
+ *
+ * Fixed timestep clock for the simulation. Every tick is the same length of
+ * game time whatever the frame rate; a frame runs however many ticks real
+ * time says are due, times the speed, and the fraction of a tick left over is
+ * used to draw between the last tick and the next.
+ */
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <stdint.h>
+#include <chrono>
+
+class SimClock
+{
+	public:
+		/// Ticks in a second of game time
+		static const int TICK_RATE = 60;
+
+		/**
+		 * SimClock(tick_rate)
+		 *
+		 * Clock running tick_rate ticks a second at normal speed
+		 */
+		SimClock( double tick_rate = TICK_RATE );
+
+		/**
+		 * Start a frame, adding the real time since the last frame
+		 */
+		void beginFrame();
+
+		/**
+		 * Start a frame elapsed seconds of real time after the last one
+		 */
+		void beginFrame( double elapsed );
+
+		/**
+		 * True while another tick is due this frame, counting it as run. Stops
+		 * early once the frame has spent its time budget on ticks.
+		 */
+		bool step();
+
+		/**
+		 * Fraction of a tick of game time between the last tick and now
+		 */
+		double getAlpha() const;
+
+		/**
+		 * Game time runs speed times real time
+		 */
+		void setSpeed( double speed );
+		double getSpeed() const { return speed; }
+
+		/**
+		 * Stop game time, keeping the speed for when it starts again
+		 */
+		void setPaused( bool paused ) { this->paused = paused; }
+		bool isPaused() const { return paused; }
+
+		/**
+		 * Most real time a frame catches up on, and most real time spent
+		 * running ticks in a frame. Game time past either is dropped, so a
+		 * slow machine runs the world slower rather than falling further
+		 * behind every frame.
+		 */
+		void setCatchUp( double max_lag, double frame_budget );
+
+		/// Ticks run, and the game time they add up to
+		uint64_t getTick() const { return tick; }
+		double getGameTime() const { return tick / tick_rate; }
+
+		double getTickRate() const { return tick_rate; }
+
+		/// Real seconds between the last two frames
+		double getFrameTime() const { return frame_time; }
+
+		/// Ticks of game time dropped to keep up
+		uint64_t getDropped() const { return dropped; }
+
+	private:
+		typedef std::chrono::steady_clock wall_clock_t;
+
+		double tick_rate;
+		double speed;
+		bool paused;
+
+		double max_lag;
+		double frame_budget;
+
+		/// Game time due but not yet run, in ticks
+		double pending;
+
+		uint64_t tick;
+		uint64_t dropped;
+
+		double frame_time;
+		bool started;
+		wall_clock_t::time_point last_frame;
+		wall_clock_t::time_point frame_start;
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * File:	simulation.cpp
+ *
+ * Author:	James Letendre
+ *
+ * The world one tick at a time
+ */
+
+#include "sim/simulation.h"
+#include "map/map.h"
+#include "entity/mover.h"
+#include "sim/worker_pool.h"
+
+#include <algorithm>
+
+// robots planned together, small enough to spread a few thousand robots
+// over every core
+#define BATCH_SIZE	256
+
+Simulation::Simulation( Map *map )
+	: map(map), pool(NULL), ticks(0)
+{
+}
+
+Simulation::~Simulation()
+{
+	// robots hand their jobs back to the map as they go
+	for( Mover *r : robots )
+		delete r;
+
+	delete map;
+	delete pool;
+}
+
+Mover* Simulation::addRobot( int x, int y )
+{
+	Mover *m = new Mover( map, x, y );
+	robots.push_back( m );
+	return m;
+}
+
+void Simulation::setThreads( int threads )
+{
+	delete pool;
+	pool = NULL;
+
+	if( threads != 1 )
+		pool = new WorkerPool( threads );
+}
+
+int Simulation::getThreads() const
+{
+	return pool ? pool->getThreads() : 1;
+}
+
+void Simulation::tick()
+{
+	// idle robots pick up their jobs here
+	map->update();
+
+	// every mover on the map, straight from the store's arrays
+	MoverStore &movers = map->getMovers();
+
+	const size_t batches = ( movers.size() + BATCH_SIZE - 1 ) / BATCH_SIZE;
+	to_apply.resize( batches );
+
+	auto plan = [&]( size_t batch, int ) {
+		const size_t end = std::min( movers.size(), (batch + 1) * BATCH_SIZE );
+		std::vector<MoverStore::slot_t> &apply = to_apply[batch];
+
+		apply.clear();
+		for( size_t i = batch * BATCH_SIZE; i < end; i++ )
+		{
+			if( movers.plan( i ) )
+				apply.push_back( i );
+		}
+	};
+
+	if( pool )
+		pool->run( batches, plan );
+	else
+	{
+		for( size_t b = 0; b < batches; b++ )
+			plan( b, 0 );
+	}
+
+	// in slot order, so ties on a cell always go the same way
+	for( std::vector<MoverStore::slot_t> &apply : to_apply )
+	{
+		for( MoverStore::slot_t slot : apply )
+			movers.apply( slot );
+	}
+
+	ticks++;
+}
@@ -0,0 +1,78 @@
+/*
+ * File:	simulation.h
+ *
+ * Author:	James Letendre
+ *
+ * The world one tick at a time: the map, its jobs and the robots working on
+ * it. Runs the same inside the game's window or headless.
+ *
+ * Every mover on the map updates in two phases. Each plans from the world as
+ * it stood at the start of the tick, touching only its own slot in the map's
+ * MoverStore, so the plans are spread over threads. Those with something to
+ * change on the map then apply their plans one at a time in slot order. A
+ * tick comes out the same whatever the number of threads, given path
+ * answers that don't depend on timing (see Map::setPathThreads).
+ */
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "entity/mover_store.h"
+
+#include <stdint.h>
+#include <vector>
+
+class Map;
+class Mover;
+class WorkerPool;
+
+class Simulation
+{
+	public:
+		/**
+		 * Simulation(map)
+		 *
+		 * Simulation of map, which it now owns
+		 */
+		Simulation( Map *map );
+
+		/**
+		 * Deletes the robots, then the map
+		 */
+		~Simulation();
+
+		/**
+		 * Put a new robot on the map at x, y
+		 */
+		Mover* addRobot( int x, int y );
+
+		/**
+		 * One fixed step of the simulation
+		 */
+		void tick();
+
+		/**
+		 * Plan robots' updates on threads threads, one per core if 0
+		 */
+		void setThreads( int threads );
+		int getThreads() const;
+
+		Map* getMap() { return map; }
+		const std::vector<Mover*>& getRobots() const { return robots; }
+
+		/// Ticks run so far
+		uint64_t getTick() const { return ticks; }
+
+	private:
+		Map *map;
+		std::vector<Mover*> robots;
+
+		/// NULL when robots plan on the calling thread
+		WorkerPool *pool;
+
+		/// Slots with plans to apply, a list for each batch of slots
+		std::vector< std::vector<MoverStore::slot_t> > to_apply;
+
+		uint64_t ticks;
+};
+
+#endif
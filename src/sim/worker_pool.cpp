@@ -0,0 +1,90 @@
+/*
+ * File:	worker_pool.cpp
+ *
+ * Author:	James Letendre
+ *
+ * Threads sharing out independent pieces of work
+ */
+
+#include "sim/worker_pool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool( int threads )
+	: threads(threads), work(NULL), count(0), generation(0), quit(false), next(0), busy(0)
+{
+	if( this->threads <= 0 )
+		this->threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+	for( int t = 1; t < this->threads; t++ )
+		workers.push_back( std::thread( &WorkerPool::workerMain, this, t ) );
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		quit = true;
+	}
+	wakeup.notify_all();
+
+	for( std::thread &t : workers )
+		t.join();
+}
+
+void WorkerPool::drain( int worker )
+{
+	for( size_t i = next++; i < count; i = next++ )
+		(*work)( i, worker );
+}
+
+void WorkerPool::run( size_t n, const work_t &work )
+{
+	if( n == 0 ) return;
+
+	// not worth waking anybody
+	if( workers.empty() || n == 1 )
+	{
+		for( size_t i = 0; i < n; i++ )
+			work( i, 0 );
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		this->work = &work;
+		count = n;
+		next = 0;
+		busy = workers.size();
+		generation++;
+	}
+	wakeup.notify_all();
+
+	drain( 0 );
+
+	// the work lives on the caller's stack, wait until nobody is using it
+	std::unique_lock<std::mutex> lock( mutex );
+	finished.wait( lock, [this]{ return busy == 0; } );
+	this->work = NULL;
+}
+
+void WorkerPool::workerMain( int worker )
+{
+	uint64_t seen = 0;
+
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			wakeup.wait( lock, [&]{ return quit || generation != seen; } );
+			if( quit ) return;
+			seen = generation;
+		}
+
+		drain( worker );
+
+		std::lock_guard<std::mutex> lock( mutex );
+		if( --busy == 0 )
+			finished.notify_one();
+	}
+}
@@ -0,0 +1,72 @@
+/*
+ * File:	worker_pool.h
+ *
+ * Author:	James Letendre
+ *
+ * Threads kept around between ticks to share out work that splits into
+ * independent pieces. Workers take the next unclaimed piece as they finish
+ * one, so a slow piece holds up one thread rather than all of them.
+ */
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+	public:
+		typedef std::function<void(size_t i, int worker)> work_t;
+
+		/**
+		 * WorkerPool(threads)
+		 *
+		 * Pool running work on threads threads, counting the caller's; one
+		 * per core if 0
+		 */
+		WorkerPool( int threads = 0 );
+
+		/**
+		 * Waits for the workers to finish and stop
+		 */
+		~WorkerPool();
+
+		/**
+		 * Call work(i, worker) for each i below n and return once every
+		 * call is done. worker is below getThreads(), 0 for the caller.
+		 */
+		void run( size_t n, const work_t &work );
+
+		int getThreads() const { return threads; }
+
+	private:
+		void workerMain( int worker );
+
+		/// Take pieces of the current run until there are none left
+		void drain( int worker );
+
+		int threads;
+		std::vector<std::thread> workers;
+
+		std::mutex mutex;
+		std::condition_variable wakeup, finished;
+
+		/// Current run, a new generation wakes the workers for it
+		const work_t *work;
+		size_t count;
+		uint64_t generation;
+		bool quit;
+
+		std::atomic<size_t> next;
+
+		/// Workers still on the current run, guarded by mutex
+		int busy;
+};
+
+#endif